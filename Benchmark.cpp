@@ -0,0 +1,1587 @@
+// Headless benchmark for the spatial partitioning, field passes, world generation and drawing of TiledWorldGenerator.
+// Each Benchmark function below times one area and checks its results; --matrix times a matrix of configurations instead.
+
+#include "TiledWorldGenerator.h"
+#include "WorldView.h"
+#include "QuadTree.h"
+#include "LinearQuadTree.h"
+#include "Node.h"
+#include "FieldKernel.h"
+#include "FieldConvolution.h"
+#include "CounterRandom.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+const int Iterations = 5;
+
+/** The world sizes the tree and field passes are timed over, the largest of which the threaded passes use. */
+const int WorldSizes[] = { 60, 120, 250, 500 };
+
+/** The thread counts the threaded passes are timed over. */
+const unsigned ThreadCounts[] = { 1, 2, 4, 8 };
+
+/** Exact field passes that only sum in a different order agree to this, relative to the largest field. */
+const float ExactFieldTolerance = 1e-5f;
+
+/** The frames each draw is timed over. */
+const int DrawFrames = 100;
+
+/** The size of the world far larger than the window. */
+const int MipWorldSize = 2048;
+
+struct Timing
+{
+	long long Best = 0;
+	long long Total = 0;
+
+	void Add(long long elapsed)
+	{
+		if (Total == 0 || elapsed < Best)
+			Best = elapsed;
+		Total += elapsed;
+	}
+};
+
+/**
+ * Times a call.
+ *
+ * @return The time the call took, in microseconds.
+ */
+template <typename Function>
+static long long TimeCall(Function function)
+{
+	high_resolution_clock::time_point startTime = high_resolution_clock::now();
+	function();
+	high_resolution_clock::time_point endTime = high_resolution_clock::now();
+	return duration_cast<microseconds>(endTime - startTime).count();
+}
+
+/**
+ * Replaces a generator's palette with count entries of varied frequency, type, strength and range.
+ */
+static void MakeWidePalette(TiledWorldGenerator& worldGen, int count)
+{
+	for (AvailableTile* entryPtr : worldGen.TilePalette)
+	{
+		delete entryPtr;
+	}
+	worldGen.TilePalette.clear();
+
+	const float fieldStrengths[] = { 0, 4, 3, -10 };
+	const float fieldRanges[] = { 0, 5, 10, 20 };
+	for (int paletteIndex = 0; paletteIndex < count; ++paletteIndex)
+	{
+		worldGen.TilePalette.push_back(new AvailableTile(1 + ((paletteIndex * 37) % 100), "Type", ImColor(255, 255, 255), (TileType)(paletteIndex % 4),
+			fieldStrengths[paletteIndex % 4], fieldRanges[(paletteIndex / 4) % 4]));
+	}
+}
+
+/**
+ * Replaces a generator's palette with one where half the tiles emit, all with the same strength and range.
+ */
+static void MakeDensePalette(TiledWorldGenerator& worldGen, float fieldRange)
+{
+	for (AvailableTile* entryPtr : worldGen.TilePalette)
+	{
+		delete entryPtr;
+	}
+	worldGen.TilePalette.clear();
+
+	worldGen.TilePalette.push_back(new AvailableTile(50, "Free", ImColor(255, 255, 255), ettFree, 0, 0));
+	worldGen.TilePalette.push_back(new AvailableTile(50, "Desirable", ImColor(0, 0, 0), ettDesirable, -1, fieldRange));
+}
+
+/**
+ * Copies the field of every tile of a generator's (full) world.
+ */
+static std::vector<Vector2f> CopyField(const TiledWorldGenerator& worldGen)
+{
+	std::vector<Vector2f> field;
+	for (const Tile& tile : worldGen.GetWorld())
+	{
+		field.push_back(tile.LocalFieldValue);
+	}
+	return field;
+}
+
+/**
+ * Gets the largest difference in either component between a generator's field and an expected one, relative to the
+ * largest expected field strength.
+ */
+static float RelativeFieldError(const TiledWorldGenerator& worldGen, const std::vector<Vector2f>& expectedField)
+{
+	const std::vector<Tile>& world = worldGen.GetWorld();
+
+	float largestField = 0;
+	float maxError = 0;
+	for (size_t tileIndex = 0; tileIndex < world.size(); ++tileIndex)
+	{
+		largestField = std::max(largestField, expectedField[tileIndex].Magnitude());
+		maxError = std::max(maxError, std::fabs(world[tileIndex].LocalFieldValue.X - expectedField[tileIndex].X));
+		maxError = std::max(maxError, std::fabs(world[tileIndex].LocalFieldValue.Y - expectedField[tileIndex].Y));
+	}
+
+	return largestField > 0 ? maxError / largestField : maxError;
+}
+
+/**
+ * Every sample of one operation in one configuration of the matrix.
+ */
+struct MatrixResult
+{
+	int Size;
+	std::string Palette;
+	unsigned long long Seed;
+	unsigned Threads;
+	std::string Mode;
+	std::string Operation;
+	long long Items;
+	std::vector<long long> Samples;
+
+	long long Percentile(double fraction) const
+	{
+		// nearest rank, so p0 is the minimum and p100 the maximum
+		std::vector<long long> sorted(Samples);
+		std::sort(sorted.begin(), sorted.end());
+		const int rank = std::max((int)std::ceil(fraction * sorted.size()), 1);
+		return sorted[rank - 1];
+	}
+};
+
+/**
+ * Runs a headless ImGui frame that draws the world into a window, as the testbed's level window does.
+ *
+ * @param worldGen The generator to draw.
+ * @param view The view to draw it with.
+ * @param vertices Receives the window's vertices.
+ * @param indices Receives the window's indices.
+ */
+static void DrawFrame(TiledWorldGenerator& worldGen, WorldView& view, std::vector<ImDrawVert>& vertices, std::vector<ImDrawIdx>& indices)
+{
+	ImGuiIO& io = ImGui::GetIO();
+	io.DisplaySize = ImVec2(1280, 720);
+	io.DeltaTime = 1.0f / 60.0f;
+
+	// the font atlas has to be built before the first frame, though nothing is ever rendered
+	unsigned char* fontPixels;
+	int fontWidth, fontHeight;
+	io.Fonts->GetTexDataAsRGBA32(&fontPixels, &fontWidth, &fontHeight);
+
+	ImGui::NewFrame();
+	ImGui::SetNextWindowSize(ImVec2(1280 - 300, 720));
+	ImGui::SetNextWindowPos(ImVec2(300, 0));
+	ImGui::Begin("Level", nullptr, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize);
+
+	view.DrawWorld(worldGen);
+
+	const ImDrawList* drawList = ImGui::GetWindowDrawList();
+	vertices.assign(drawList->VtxBuffer.Data, drawList->VtxBuffer.Data + drawList->VtxBuffer.Size);
+	indices.assign(drawList->IdxBuffer.Data, drawList->IdxBuffer.Data + drawList->IdxBuffer.Size);
+
+	ImGui::End();
+	ImGui::Render();
+}
+
+static std::vector<std::string> SplitList(const char* list)
+{
+	std::vector<std::string> items;
+	std::string item;
+	for (const char* character = list; ; ++character)
+	{
+		if (*character == ',' || *character == '\0')
+		{
+			if (!item.empty())
+				items.push_back(item);
+			item.clear();
+
+			if (*character == '\0')
+				return items;
+		}
+		else
+		{
+			item += *character;
+		}
+	}
+}
+
+/**
+ * Times Generate, BuildTree, CalculateField and tree queries over every combination of the world sizes, palettes,
+ * seeds, thread counts and field modes given on the command line, and writes min, median and p99 times and the
+ * throughput of each as CSV or JSON. Needs no display, so it can run on build servers.
+ *
+ * Benchmark --matrix [--format csv|json] [--output file] [--samples n] [--sizes 120,250] [--palettes default,wide]
+ *                    [--seeds 1,2] [--threads 1,4] [--modes gather,scatter,convolution,layered,aggregate]
+ */
+static int RunMatrix(int argc, char** argv)
+{
+	std::string format = "csv";
+	const char* outputPath = nullptr;
+	int sampleCount = 11;
+	std::vector<std::string> sizes = { "120", "250", "500" };
+	std::vector<std::string> palettes = { "default", "wide" };
+	std::vector<std::string> seeds = { "1", "2", "3" };
+	std::vector<std::string> threadCounts = { "1", "2", "4", "8" };
+	std::vector<std::string> modes = { "gather", "scatter", "convolution" };
+
+	const char* modeNames[] = { "gather", "scatter", "convolution", "layered", "aggregate" };
+	const int QueryCount = 10000;
+	const int WidePaletteSize = 32;
+
+	for (int argIndex = 2; argIndex + 1 < argc; argIndex += 2)
+	{
+		const std::string option = argv[argIndex];
+		const char* value = argv[argIndex + 1];
+
+		if (option == "--format")
+			format = value;
+		else if (option == "--output")
+			outputPath = value;
+		else if (option == "--samples")
+			sampleCount = std::max(atoi(value), 1);
+		else if (option == "--sizes")
+			sizes = SplitList(value);
+		else if (option == "--palettes")
+			palettes = SplitList(value);
+		else if (option == "--seeds")
+			seeds = SplitList(value);
+		else if (option == "--threads")
+			threadCounts = SplitList(value);
+		else if (option == "--modes")
+			modes = SplitList(value);
+		else
+		{
+			fprintf(stderr, "Unknown option %s\n", option.c_str());
+			return 1;
+		}
+	}
+
+	if (format != "csv" && format != "json")
+	{
+		fprintf(stderr, "Unknown format %s, expected csv or json\n", format.c_str());
+		return 1;
+	}
+
+	std::vector<MatrixResult> results;
+	for (const std::string& size : sizes)
+	{
+		for (const std::string& palette : palettes)
+		{
+			for (const std::string& seed : seeds)
+			{
+				for (const std::string& threadCount : threadCounts)
+				{
+					for (const std::string& mode : modes)
+					{
+						TiledWorldGenerator worldGen;
+						worldGen.Length = atoi(size.c_str());
+						worldGen.Width = worldGen.Length;
+						worldGen.Seed = strtoull(seed.c_str(), nullptr, 10);
+						worldGen.ThreadCount = (unsigned)atoi(threadCount.c_str());
+
+						const int modeIndex = (int)(std::find(std::begin(modeNames), std::end(modeNames), mode) - std::begin(modeNames));
+						if (modeIndex == (int)(sizeof(modeNames) / sizeof(modeNames[0])))
+						{
+							fprintf(stderr, "Unknown field mode %s\n", mode.c_str());
+							return 1;
+						}
+						worldGen.FieldCalculationMode = (FieldMode)modeIndex;
+
+						if (palette == "wide")
+							MakeWidePalette(worldGen, WidePaletteSize);
+						else if (palette != "default")
+						{
+							fprintf(stderr, "Unknown palette %s, expected default or wide\n", palette.c_str());
+							return 1;
+						}
+
+						const long long cellCount = (long long)worldGen.Length * worldGen.Width;
+						MatrixResult generateResult = { worldGen.Length, palette, worldGen.Seed, worldGen.ThreadCount, mode, "generate", cellCount, {} };
+						MatrixResult treeResult = generateResult;
+						treeResult.Operation = "tree";
+						MatrixResult fieldResult = generateResult;
+						fieldResult.Operation = "field";
+						MatrixResult queryResult = generateResult;
+						queryResult.Operation = "query";
+						queryResult.Items = QueryCount;
+
+						for (int sample = 0; sample < sampleCount; ++sample)
+						{
+							high_resolution_clock::time_point startTime = high_resolution_clock::now();
+							worldGen.Generate();
+							high_resolution_clock::time_point generatedTime = high_resolution_clock::now();
+							worldGen.BuildTree();
+							high_resolution_clock::time_point builtTime = high_resolution_clock::now();
+							worldGen.CalculateField();
+							high_resolution_clock::time_point endTime = high_resolution_clock::now();
+
+							generateResult.Samples.push_back(duration_cast<microseconds>(generatedTime - startTime).count());
+							treeResult.Samples.push_back(duration_cast<microseconds>(builtTime - generatedTime).count());
+							fieldResult.Samples.push_back(duration_cast<microseconds>(endTime - builtTime).count());
+
+							// the same spread of targets every sample, so only the tree changes between runs
+							int foundTiles = 0;
+							high_resolution_clock::time_point queryStartTime = high_resolution_clock::now();
+							for (int query = 0; query < QueryCount; ++query)
+							{
+								uint32_t random[4];
+								CounterRandom::Generate(worldGen.Seed, (uint32_t)query, 0, 1, 0, random);
+								const Vector2f target(CounterRandom::ToUnitFloat(random[0]) * worldGen.Length, CounterRandom::ToUnitFloat(random[1]) * worldGen.Width);
+								worldGen.VisitSelectedNode(target, [&foundTiles](const Tile&) { ++foundTiles; });
+							}
+							high_resolution_clock::time_point queryEndTime = high_resolution_clock::now();
+							queryResult.Samples.push_back(duration_cast<microseconds>(queryEndTime - queryStartTime).count());
+
+							// keep the queries from being optimised away
+							if (foundTiles < 0)
+								return 1;
+						}
+
+						results.push_back(generateResult);
+						results.push_back(treeResult);
+						results.push_back(fieldResult);
+						results.push_back(queryResult);
+					}
+				}
+			}
+		}
+	}
+
+	FILE* output = outputPath ? fopen(outputPath, "w") : stdout;
+	if (!output)
+	{
+		fprintf(stderr, "Couldn't open %s for writing\n", outputPath);
+		return 1;
+	}
+
+	if (format == "csv")
+		fprintf(output, "size,palette,seed,threads,mode,operation,samples,min_us,median_us,p99_us,items_per_second\n");
+	else
+		fprintf(output, "[\n");
+
+	for (size_t resultIndex = 0; resultIndex < results.size(); ++resultIndex)
+	{
+		const MatrixResult& result = results[resultIndex];
+		const long long median = result.Percentile(0.5);
+		const double throughput = (median > 0) ? (result.Items * 1e6) / median : 0.0;
+
+		if (format == "csv")
+		{
+			fprintf(output, "%d,%s,%llu,%u,%s,%s,%d,%lld,%lld,%lld,%.0f\n", result.Size, result.Palette.c_str(), result.Seed, result.Threads,
+				result.Mode.c_str(), result.Operation.c_str(), (int)result.Samples.size(), result.Percentile(0), median, result.Percentile(0.99), throughput);
+		}
+		else
+		{
+			fprintf(output, "  {\"size\": %d, \"palette\": \"%s\", \"seed\": %llu, \"threads\": %u, \"mode\": \"%s\", \"operation\": \"%s\", "
+				"\"samples\": %d, \"min_us\": %lld, \"median_us\": %lld, \"p99_us\": %lld, \"items_per_second\": %.0f}%s\n",
+				result.Size, result.Palette.c_str(), result.Seed, result.Threads, result.Mode.c_str(), result.Operation.c_str(),
+				(int)result.Samples.size(), result.Percentile(0), median, result.Percentile(0.99), throughput,
+				(resultIndex + 1 < results.size()) ? "," : "");
+		}
+	}
+
+	if (format == "json")
+		fprintf(output, "]\n");
+
+	if (outputPath)
+		fclose(output);
+
+	return 0;
+}
+
+/**
+ * Builds the tree over every tile with the pointer based Node, the pooled QuadTree (sequentially and in parallel) and
+ * the bulk loaded LinearQuadTree.
+ */
+static bool BenchmarkTreeBuilds()
+{
+	printf("%10s %10s %16s %16s %16s %16s %16s %16s %16s %16s\n", "size", "tiles", "Node best(us)", "Node avg(us)", "Pool best(us)", "Pool avg(us)",
+		"Parallel best(us)", "Parallel avg(us)", "Linear best(us)", "Linear avg(us)");
+
+	for (int worldSize : WorldSizes)
+	{
+		TiledWorldGenerator worldGen;
+		worldGen.Length = worldSize;
+		worldGen.Width = worldSize;
+
+		worldGen.Generate();
+
+		// the trees are built over every tile, by handle into a copy of the world they are allowed to move
+		std::vector<Tile> world(worldGen.GetWorld());
+		std::vector<int> handles(world.size());
+		std::iota(handles.begin(), handles.end(), 0);
+		const AABBf worldBounds(Vector2f::Zero, Vector2f((float)worldSize, (float)worldSize));
+
+		// the original pointer based tree, allocating every node
+		Timing nodeTiming;
+		int nodeLeafTiles = 0;
+		for (int iteration = 0; iteration < Iterations; ++iteration)
+		{
+			Node* rootNode = nullptr;
+			nodeTiming.Add(TimeCall([&]
+			{
+				rootNode = new Node(worldBounds.boxMin, worldBounds.boxMax, nullptr, 0);
+				for (Tile& tile : world)
+				{
+					rootNode->AddObject(&tile);
+				}
+			}));
+
+			nodeLeafTiles = (int)rootNode->FindTiles(Vector2f(worldSize / 2.0f, worldSize / 2.0f)).size();
+			delete rootNode;
+		}
+
+		// the pooled tree, reset and rebuilt in place
+		Timing poolTiming;
+		int poolLeafTiles = 0;
+		QuadTree tree;
+		for (int iteration = 0; iteration < Iterations; ++iteration)
+		{
+			poolTiming.Add(TimeCall([&] { tree.Build(worldBounds, world, handles); }));
+
+			poolLeafTiles = (int)tree.FindTiles(Vector2f(worldSize / 2.0f, worldSize / 2.0f)).size();
+		}
+
+		// the pooled tree, built top down with the quadrants of large nodes on separate threads
+		Timing parallelTiming;
+		int parallelLeafTiles = 0;
+		QuadTree parallelTree;
+		for (int iteration = 0; iteration < Iterations; ++iteration)
+		{
+			parallelTiming.Add(TimeCall([&] { parallelTree.BuildParallel(worldBounds, world, handles); }));
+
+			parallelLeafTiles = (int)parallelTree.FindTiles(Vector2f(worldSize / 2.0f, worldSize / 2.0f)).size();
+		}
+
+		// the bulk loaded linear tree
+		Timing linearTiming;
+		LinearQuadTree linearTree;
+		for (int iteration = 0; iteration < Iterations; ++iteration)
+		{
+			linearTiming.Add(TimeCall([&] { linearTree.Build(worldBounds, world, handles); }));
+		}
+
+		if (nodeLeafTiles != poolLeafTiles || nodeLeafTiles != parallelLeafTiles || tree.NodeCount() != parallelTree.NodeCount())
+		{
+			fprintf(stderr, "Mismatch at size %d: Node found %d tiles, QuadTree found %d, parallel QuadTree found %d\n", 
+				worldSize, nodeLeafTiles, poolLeafTiles, parallelLeafTiles);
+			return false;
+		}
+
+		printf("%10d %10d %16lld %16lld %16lld %16lld %16lld %16lld %16lld %16lld\n", worldSize, (int)world.size(),
+			nodeTiming.Best, nodeTiming.Total / Iterations,
+			poolTiming.Best, poolTiming.Total / Iterations,
+			parallelTiming.Best, parallelTiming.Total / Iterations,
+			linearTiming.Best, linearTiming.Total / Iterations);
+	}
+
+	return true;
+}
+
+/**
+ * Checks that the generator queries the tree it built, whatever BulkLoadTree is set to now.
+ */
+static bool BenchmarkTreeQueries()
+{
+	// queries search the tree that was built, not the one BulkLoadTree asks for next
+	TiledWorldGenerator queryWorldGen;
+	queryWorldGen.Generate();
+	queryWorldGen.BuildTree();
+
+	int builtTreeTiles = 0;
+	int toggledTreeTiles = 0;
+	const Vector2f queryTarget(queryWorldGen.Length / 2.0f, queryWorldGen.Width / 2.0f);
+	queryWorldGen.VisitSelectedNode(queryTarget, [&builtTreeTiles](const Tile&) { ++builtTreeTiles; });
+	queryWorldGen.BulkLoadTree = true;
+	queryWorldGen.VisitSelectedNode(queryTarget, [&toggledTreeTiles](const Tile&) { ++toggledTreeTiles; });
+
+	if (builtTreeTiles == 0 || toggledTreeTiles != builtTreeTiles)
+	{
+		fprintf(stderr, "Toggling BulkLoadTree changed a query from %d tiles to %d\n", builtTreeTiles, toggledTreeTiles);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Times the gather field pass with the scalar kernel and the best supported vector kernel.
+ */
+static bool BenchmarkGatherKernels()
+{
+	const KernelIsa vectorIsa = FieldKernel::BestIsa();
+	const char* isaNames[] = { "Scalar", "SSE", "AVX2" };
+
+	printf("\n%10s %10s %16s %16s %16s %16s %16s\n", "size", "tiles", "Scalar best(us)", "Scalar avg(us)", "Vector best(us)", "Vector avg(us)", "Max rel error");
+
+	for (int worldSize : WorldSizes)
+	{
+		TiledWorldGenerator worldGen;
+		worldGen.Length = worldSize;
+		worldGen.Width = worldSize;
+
+		worldGen.Generate();
+
+		// time the field pass with each kernel, keeping the scalar kernel's last result to compare
+		std::vector<Vector2f> scalarField;
+		Timing fieldTimings[2];
+		const KernelIsa kernels[2] = { ekiScalar, vectorIsa };
+		for (int kernel = 0; kernel < 2; ++kernel)
+		{
+			worldGen.GatherKernel = kernels[kernel];
+			for (int iteration = 0; iteration < Iterations; ++iteration)
+			{
+				fieldTimings[kernel].Add(TimeCall([&] { worldGen.CalculateField(); }));
+			}
+
+			if (kernels[kernel] == ekiScalar)
+				scalarField = CopyField(worldGen);
+		}
+
+		const float relativeError = RelativeFieldError(worldGen, scalarField);
+
+		if (relativeError > FieldKernel::Tolerance)
+		{
+			fprintf(stderr, "%s kernel out of tolerance at size %d: relative error %g\n", isaNames[vectorIsa], worldSize, relativeError);
+			return false;
+		}
+
+		printf("%10d %10d %16lld %16lld %16lld %16lld %16g\n", worldSize, worldSize * worldSize,
+			fieldTimings[0].Best, fieldTimings[0].Total / Iterations,
+			fieldTimings[1].Best, fieldTimings[1].Total / Iterations,
+			relativeError);
+	}
+
+	return true;
+}
+
+/**
+ * Times the scatter field pass against the FFT convolution.
+ */
+static bool BenchmarkConvolution()
+{
+	printf("\n%10s %10s %16s %16s %16s %16s %16s\n", "size", "tiles", "Scatter best(us)", "Scatter avg(us)", "FFT best(us)", "FFT avg(us)", "Max rel error");
+
+	for (int worldSize : WorldSizes)
+	{
+		TiledWorldGenerator worldGen;
+		worldGen.Length = worldSize;
+		worldGen.Width = worldSize;
+
+		worldGen.Generate();
+
+		std::vector<Vector2f> scatteredField;
+		Timing fieldTimings[2];
+		const FieldMode modes[2] = { efmScatter, efmConvolution };
+		for (int mode = 0; mode < 2; ++mode)
+		{
+			worldGen.FieldCalculationMode = modes[mode];
+			for (int iteration = 0; iteration < Iterations; ++iteration)
+			{
+				fieldTimings[mode].Add(TimeCall([&] { worldGen.CalculateField(); }));
+			}
+
+			if (modes[mode] == efmScatter)
+				scatteredField = CopyField(worldGen);
+		}
+
+		const float relativeError = RelativeFieldError(worldGen, scatteredField);
+
+		if (relativeError > FieldConvolution::Tolerance)
+		{
+			fprintf(stderr, "FFT convolution out of tolerance at size %d: relative error %g\n", worldSize, relativeError);
+			return false;
+		}
+
+		printf("%10d %10d %16lld %16lld %16lld %16lld %16g\n", worldSize, worldSize * worldSize,
+			fieldTimings[0].Best, fieldTimings[0].Total / Iterations,
+			fieldTimings[1].Best, fieldTimings[1].Total / Iterations,
+			relativeError);
+	}
+
+	return true;
+}
+
+/**
+ * Times the scatter field pass against a layer per palette entry, and re-weighting the layers after a strength change.
+ */
+static bool BenchmarkLayers()
+{
+	// a wide palette's entries share tile types, but each still gets its own layer, so the layers must add up to the
+	// scattered field, and still do after one entry's strength and range change
+	const int LayerPaletteSize = 32;
+
+	printf("\n%10s %10s %16s %16s %16s %16s\n", "size", "palette", "Scatter best(us)", "Layered best(us)", "Reweight best(us)", "Max rel error");
+
+	for (int worldSize : WorldSizes)
+	{
+		TiledWorldGenerator layerWorldGen;
+		layerWorldGen.Length = worldSize;
+		layerWorldGen.Width = worldSize;
+		MakeWidePalette(layerWorldGen, LayerPaletteSize);
+
+		layerWorldGen.Generate();
+
+		Timing scatterTiming, layeredTiming, reweightTiming;
+		float layerError = 0;
+		for (int iteration = 0; iteration < Iterations; ++iteration)
+		{
+			layerWorldGen.FieldCalculationMode = efmScatter;
+			scatterTiming.Add(TimeCall([&] { layerWorldGen.CalculateField(); }));
+
+			std::vector<Vector2f> scatteredField = CopyField(layerWorldGen);
+
+			layerWorldGen.FieldCalculationMode = efmLayered;
+			layeredTiming.Add(TimeCall([&] { layerWorldGen.CalculateField(); }));
+
+			layerError = std::max(layerError, RelativeFieldError(layerWorldGen, scatteredField));
+
+			// entries 1, 5, 9... share a type, only the one changed may move
+			const int paletteIndex = 1 + ((iteration * 4) % LayerPaletteSize);
+			reweightTiming.Add(TimeCall([&] { layerWorldGen.SetFieldStrength(paletteIndex, -2.0f * (iteration + 1)); }));
+			layerWorldGen.SetFieldRange(paletteIndex, 3.0f + iteration);
+
+			std::vector<Vector2f> layeredField = CopyField(layerWorldGen);
+
+			layerWorldGen.FieldCalculationMode = efmScatter;
+			layerWorldGen.CalculateField();
+			scatteredField = CopyField(layerWorldGen);
+			layerWorldGen.FieldCalculationMode = efmLayered;
+			layerWorldGen.CalculateField();
+
+			layerError = std::max(layerError, RelativeFieldError(layerWorldGen, scatteredField));
+			if (RelativeFieldError(layerWorldGen, layeredField) != 0)
+			{
+				fprintf(stderr, "Re-weighting the layers differs from layering the field again at size %d\n", worldSize);
+				return false;
+			}
+		}
+
+		if (layerError > ExactFieldTolerance)
+		{
+			fprintf(stderr, "Layered field differs from the scattered field with %d palette entries at size %d: relative error %g\n",
+				LayerPaletteSize, worldSize, layerError);
+			return false;
+		}
+
+		printf("%10d %10d %16lld %16lld %16lld %16g\n", worldSize, LayerPaletteSize, scatterTiming.Best, layeredTiming.Best, reweightTiming.Best, layerError);
+	}
+
+	return true;
+}
+
+/**
+ * Checks the Barnes-Hut field against the scatter where it never approximates.
+ */
+static bool BenchmarkAggregateExact()
+{
+	// with an opening angle of 0 the aggregate tree never approximates, so it must give the scattered field however
+	// many palette entries there are
+	const int aggregateWorldSizes[] = { 60, 120 };
+	const int aggregatePaletteSizes[] = { 32, 64 };
+
+	printf("\n%10s %10s %16s %16s %16s\n", "size", "palette", "Scatter best(us)", "Barnes-Hut best(us)", "Max rel error");
+
+	for (int worldSize : aggregateWorldSizes)
+	{
+		for (int paletteSize : aggregatePaletteSizes)
+		{
+			TiledWorldGenerator aggregateWorldGen;
+			aggregateWorldGen.Length = worldSize;
+			aggregateWorldGen.Width = worldSize;
+			aggregateWorldGen.OpeningAngle = 0;
+			MakeWidePalette(aggregateWorldGen, paletteSize);
+
+			aggregateWorldGen.Generate();
+
+			Timing scatterTiming, aggregateTiming;
+			std::vector<Vector2f> scatteredField;
+			float aggregateError = 0;
+			for (int iteration = 0; iteration < Iterations; ++iteration)
+			{
+				aggregateWorldGen.FieldCalculationMode = efmScatter;
+				scatterTiming.Add(TimeCall([&] { aggregateWorldGen.CalculateField(); }));
+
+				scatteredField = CopyField(aggregateWorldGen);
+
+				aggregateWorldGen.FieldCalculationMode = efmAggregate;
+				aggregateTiming.Add(TimeCall([&] { aggregateWorldGen.CalculateField(); }));
+
+				aggregateError = std::max(aggregateError, RelativeFieldError(aggregateWorldGen, scatteredField));
+			}
+
+			if (aggregateError > ExactFieldTolerance)
+			{
+				fprintf(stderr, "Barnes-Hut field differs from the scattered field with %d palette entries at size %d: relative error %g\n",
+					paletteSize, worldSize, aggregateError);
+				return false;
+			}
+
+			printf("%10d %10d %16lld %16lld %16g\n", worldSize, paletteSize, scatterTiming.Best, aggregateTiming.Best, aggregateError);
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Times the Barnes-Hut field against the scatter over a range of opening angles, and checks its error.
+ */
+static bool BenchmarkAggregateApproximation()
+{
+	// past 0 the error must stay within a bound for the angle, and be what the generator measures against the exact
+	// field; an edit can't be patched into an approximate field, so it has to invalidate the field and its error
+	const int approximateWorldSize = 250;
+	const float openingAngles[] = { 0.25f, 0.5f, 1.0f };
+	const float approximationBounds[] = { 0.01f, 0.03f, 0.1f };
+
+	printf("\n%10s %10s %16s %16s %16s %16s\n", "size", "angle", "Scatter best(us)", "Barnes-Hut best(us)", "Measured error", "Error bound");
+
+	TiledWorldGenerator approximateWorldGen;
+	approximateWorldGen.Length = approximateWorldSize;
+	approximateWorldGen.Width = approximateWorldSize;
+	approximateWorldGen.MeasureApproximationError = true;
+
+	approximateWorldGen.Generate();
+
+	for (int angleIndex = 0; angleIndex < (int)(sizeof(openingAngles) / sizeof(openingAngles[0])); ++angleIndex)
+	{
+		approximateWorldGen.OpeningAngle = openingAngles[angleIndex];
+
+		Timing scatterTiming, aggregateTiming;
+		float measuredError = 0;
+		float approximationError = 0;
+		for (int iteration = 0; iteration < Iterations; ++iteration)
+		{
+			approximateWorldGen.FieldCalculationMode = efmScatter;
+			scatterTiming.Add(TimeCall([&] { approximateWorldGen.CalculateField(); }));
+
+			const std::vector<Vector2f> scatteredField = CopyField(approximateWorldGen);
+
+			// the measurement is part of the field pass, so it is timed separately
+			approximateWorldGen.FieldCalculationMode = efmAggregate;
+			approximateWorldGen.MeasureApproximationError = false;
+			aggregateTiming.Add(TimeCall([&] { approximateWorldGen.CalculateField(); }));
+
+			approximateWorldGen.MeasureApproximationError = true;
+			approximateWorldGen.CalculateField();
+			measuredError = approximateWorldGen.GetApproximationError();
+			approximationError = RelativeFieldError(approximateWorldGen, scatteredField);
+		}
+
+		if (approximationError > approximationBounds[angleIndex] || std::fabs(measuredError - approximationError) > 1e-6f)
+		{
+			fprintf(stderr, "Barnes-Hut field out of bounds at opening angle %g: relative error %g (measured %g, bound %g)\n",
+				openingAngles[angleIndex], approximationError, measuredError, approximationBounds[angleIndex]);
+			return false;
+		}
+
+		printf("%10d %10g %16lld %16lld %16g %16g\n", approximateWorldSize, openingAngles[angleIndex], scatterTiming.Best, aggregateTiming.Best,
+			measuredError, approximationBounds[angleIndex]);
+	}
+
+	approximateWorldGen.SetTileType(approximateWorldSize / 2, approximateWorldSize / 2, *approximateWorldGen.TilePalette[3]);
+	if (approximateWorldGen.GetApproximationError() != -1)
+	{
+		fprintf(stderr, "Editing an approximate field left its approximation error in place\n");
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Times the Barnes-Hut field against the exact field modes with dense, far reaching emitters.
+ */
+static bool BenchmarkAggregateDense()
+{
+	// where emitters are dense and reach far, scatter and gather cost the square of the range per receiver, while the
+	// aggregate tree's cost grows with its log; the world is kept small, as the gather's tree holds a copy of every
+	// emitter in each leaf it reaches
+	const int denseWorldSize = 120;
+	const float denseFieldRanges[] = { 60, 120 };
+	const int DenseIterations = 2;
+	const float DenseOpeningAngle = 0.5f;
+	const float DenseErrorBound = 0.03f;
+
+	printf("\n%10s %10s %16s %16s %16s %16s %16s %16s %16s\n", "size", "range", "Scatter best(us)", "Gather best(us)", "FFT best(us)",
+		"Barnes-Hut best(us)", "Speedup", "Tree nodes", "Max rel error");
+
+	for (float fieldRange : denseFieldRanges)
+	{
+		TiledWorldGenerator denseWorldGen;
+		denseWorldGen.Length = denseWorldSize;
+		denseWorldGen.Width = denseWorldSize;
+		denseWorldGen.OpeningAngle = DenseOpeningAngle;
+		MakeDensePalette(denseWorldGen, fieldRange);
+
+		denseWorldGen.Generate();
+
+		const FieldMode modes[4] = { efmScatter, efmGather, efmConvolution, efmAggregate };
+		Timing modeTimings[4];
+		std::vector<Vector2f> scatteredField;
+		for (int mode = 0; mode < 4; ++mode)
+		{
+			denseWorldGen.FieldCalculationMode = modes[mode];
+			for (int iteration = 0; iteration < DenseIterations; ++iteration)
+			{
+				modeTimings[mode].Add(TimeCall([&] { denseWorldGen.CalculateField(); }));
+			}
+
+			if (modes[mode] == efmScatter)
+				scatteredField = CopyField(denseWorldGen);
+		}
+
+		const float denseError = RelativeFieldError(denseWorldGen, scatteredField);
+		if (denseError > DenseErrorBound)
+		{
+			fprintf(stderr, "Barnes-Hut field out of bounds with dense emitters of range %g: relative error %g\n", fieldRange, denseError);
+			return false;
+		}
+
+		// against the faster of the two exact passes that visit every emitter a receiver can see
+		const long long exactBest = std::min(modeTimings[0].Best, modeTimings[1].Best);
+		printf("%10d %10g %16lld %16lld %16lld %16lld %15.1fx %16d %16g\n", denseWorldSize, fieldRange, modeTimings[0].Best,
+			modeTimings[1].Best, modeTimings[2].Best, modeTimings[3].Best, (double)exactBest / std::max(modeTimings[3].Best, 1LL),
+			(int)denseWorldGen.GetAggregateNodeCount(), denseError);
+	}
+
+	return true;
+}
+
+/**
+ * Times the field pass on the largest world over a range of thread counts.
+ */
+static bool BenchmarkFieldThreads()
+{
+	// the threaded field pass on the largest world, which must give the same result whatever the thread count
+	const int threadWorldSize = WorldSizes[sizeof(WorldSizes) / sizeof(WorldSizes[0]) - 1];
+
+	TiledWorldGenerator threadWorldGen;
+	threadWorldGen.Length = threadWorldSize;
+	threadWorldGen.Width = threadWorldSize;
+
+	threadWorldGen.Generate();
+
+	printf("\n%10s %10s %16s %16s %16s\n", "size", "threads", "Field best(us)", "Field avg(us)", "Speedup");
+
+	std::vector<Vector2f> singleThreadField;
+	long long singleThreadBest = 0;
+	for (unsigned threadCount : ThreadCounts)
+	{
+		threadWorldGen.ThreadCount = threadCount;
+
+		Timing fieldTiming;
+		for (int iteration = 0; iteration < Iterations; ++iteration)
+		{
+			fieldTiming.Add(TimeCall([&] { threadWorldGen.CalculateField(); }));
+		}
+
+		const std::vector<Tile>& world = threadWorldGen.GetWorld();
+		if (singleThreadField.empty())
+		{
+			singleThreadBest = fieldTiming.Best;
+			for (const Tile& tile : world)
+			{
+				singleThreadField.push_back(tile.LocalFieldValue);
+			}
+		}
+
+		for (size_t tileIndex = 0; tileIndex < world.size(); ++tileIndex)
+		{
+			if (world[tileIndex].LocalFieldValue.X != singleThreadField[tileIndex].X || world[tileIndex].LocalFieldValue.Y != singleThreadField[tileIndex].Y)
+			{
+				fprintf(stderr, "Field with %u threads differs from the single threaded field at tile %d\n", threadCount, (int)tileIndex);
+				return false;
+			}
+		}
+
+		printf("%10d %10u %16lld %16lld %16.2f\n", threadWorldSize, threadCount, fieldTiming.Best, fieldTiming.Total / Iterations,
+			fieldTiming.Best > 0 ? (double)singleThreadBest / fieldTiming.Best : 0.0);
+	}
+
+	return true;
+}
+
+/**
+ * Times patching the field after single tile edits on the largest world.
+ */
+static bool BenchmarkPatching()
+{
+	// random single tile edits, patched in place, must end up where a full recalculation does
+	const int patchWorldSize = WorldSizes[sizeof(WorldSizes) / sizeof(WorldSizes[0]) - 1];
+	const int EditCount = 1000;
+	const float PatchTolerance = 1e-5f;
+
+	TiledWorldGenerator patchWorldGen;
+	patchWorldGen.Length = patchWorldSize;
+	patchWorldGen.Width = patchWorldSize;
+
+	patchWorldGen.Generate();
+	patchWorldGen.CalculateField();
+	srand(1);
+
+	Timing editTiming;
+	for (int edit = 0; edit < EditCount; ++edit)
+	{
+		const int x = rand() % patchWorldSize;
+		const int y = rand() % patchWorldSize;
+		const AvailableTile& tileType = *patchWorldGen.TilePalette[rand() % patchWorldGen.TilePalette.size()];
+
+		editTiming.Add(TimeCall([&] { patchWorldGen.SetTileType(x, y, tileType); }));
+	}
+
+	std::vector<Vector2f> patchedField;
+	for (const Tile& tile : patchWorldGen.GetWorld())
+	{
+		patchedField.push_back(tile.LocalFieldValue);
+	}
+	const float patchedLargest = patchWorldGen.GetLargestFieldStrength();
+
+	patchWorldGen.CalculateField();
+
+	float maxPatchError = 0;
+	for (size_t tileIndex = 0; tileIndex < patchedField.size(); ++tileIndex)
+	{
+		const Vector2f& field = patchWorldGen.GetWorld()[tileIndex].LocalFieldValue;
+		maxPatchError = std::max(maxPatchError, std::fabs(patchedField[tileIndex].X - field.X));
+		maxPatchError = std::max(maxPatchError, std::fabs(patchedField[tileIndex].Y - field.Y));
+	}
+	const float largestField = patchWorldGen.GetLargestFieldStrength();
+	const float patchError = largestField > 0 ? std::max(maxPatchError, std::fabs(patchedLargest - largestField)) / largestField : 0;
+
+	if (patchError > PatchTolerance)
+	{
+		fprintf(stderr, "Patched field drifted after %d edits: relative error %g\n", EditCount, patchError);
+		return false;
+	}
+
+	printf("\n%10s %10s %16s %16s %16s\n", "size", "edits", "Edit best(us)", "Edit avg(us)", "Max rel error");
+	printf("%10d %10d %16lld %16lld %16g\n", patchWorldSize, EditCount, editTiming.Best, editTiming.Total / EditCount, patchError);
+
+	return true;
+}
+
+/**
+ * Times generating and scattering the compact palette index world against the full one.
+ */
+static bool BenchmarkCompactWorld()
+{
+	// the compact world must generate the same cells and scatter the same field as the full one
+	const int compactWorldSizes[] = { 250, 500, 1000 };
+
+	printf("\n%10s %10s %16s %16s %16s %16s %16s %16s\n", "size", "cells", "Full bytes", "Compact bytes", "Full gen(us)", "Compact gen(us)",
+		"Full field(us)", "Compact field(us)");
+
+	for (int worldSize : compactWorldSizes)
+	{
+		TiledWorldGenerator fullWorldGen;
+		TiledWorldGenerator compactWorldGen;
+		fullWorldGen.FieldCalculationMode = efmScatter;
+		compactWorldGen.CompactWorld = true;
+
+		Timing fullGenTiming, compactGenTiming, fullFieldTiming, compactFieldTiming;
+		for (int iteration = 0; iteration < Iterations; ++iteration)
+		{
+			for (TiledWorldGenerator* worldGenPtr : { &fullWorldGen, &compactWorldGen })
+			{
+				worldGenPtr->Length = worldSize;
+				worldGenPtr->Width = worldSize;
+
+				high_resolution_clock::time_point startTime = high_resolution_clock::now();
+
+				worldGenPtr->Generate();
+
+				high_resolution_clock::time_point midTime = high_resolution_clock::now();
+
+				worldGenPtr->CalculateField();
+
+				high_resolution_clock::time_point endTime = high_resolution_clock::now();
+				(worldGenPtr == &fullWorldGen ? fullGenTiming : compactGenTiming).Add(duration_cast<microseconds>(midTime - startTime).count());
+				(worldGenPtr == &fullWorldGen ? fullFieldTiming : compactFieldTiming).Add(duration_cast<microseconds>(endTime - midTime).count());
+			}
+		}
+
+		if (!compactWorldGen.IsWorldCompact() || compactWorldGen.GetLargestFieldStrength() != fullWorldGen.GetLargestFieldStrength())
+		{
+			fprintf(stderr, "Compact world differs from the full world at size %d\n", worldSize);
+			return false;
+		}
+
+		for (int x = 0; x < worldSize; ++x)
+		{
+			for (int y = 0; y < worldSize; ++y)
+			{
+				const Vector2f& fullField = fullWorldGen.GetFieldAt(x, y);
+				const Vector2f& compactField = compactWorldGen.GetFieldAt(x, y);
+				if (fullField.X != compactField.X || fullField.Y != compactField.Y)
+				{
+					fprintf(stderr, "Compact field differs from the full field at %d, %d\n", x, y);
+					return false;
+				}
+			}
+		}
+
+		printf("%10d %10d %16d %16d %16lld %16lld %16lld %16lld\n", worldSize, worldSize * worldSize,
+			(int)sizeof(Tile), (int)(sizeof(uint8_t) + sizeof(Vector2f)),
+			fullGenTiming.Best, compactGenTiming.Best, fullFieldTiming.Best, compactFieldTiming.Best);
+	}
+
+	return true;
+}
+
+/**
+ * Times generation over a range of thread counts.
+ */
+static bool BenchmarkGenerationThreads()
+{
+	// generation is keyed by the seed and the cell, so every thread count must give the same world
+	const int generationWorldSize = 1000;
+	TiledWorldGenerator generationWorldGen;
+	generationWorldGen.Length = generationWorldSize;
+	generationWorldGen.Width = generationWorldSize;
+
+	printf("\n%10s %10s %16s %16s %16s\n", "size", "threads", "Gen best(us)", "Gen avg(us)", "Speedup");
+
+	std::vector<TileType> singleThreadTypes;
+	long long singleThreadGenBest = 0;
+	for (unsigned threadCount : ThreadCounts)
+	{
+		generationWorldGen.ThreadCount = threadCount;
+
+		Timing generationTiming;
+		for (int iteration = 0; iteration < Iterations; ++iteration)
+		{
+			generationTiming.Add(TimeCall([&] { generationWorldGen.Generate(); }));
+		}
+
+		const std::vector<Tile>& world = generationWorldGen.GetWorld();
+		if (singleThreadTypes.empty())
+		{
+			singleThreadGenBest = generationTiming.Best;
+			for (const Tile& tile : world)
+			{
+				singleThreadTypes.push_back(tile.Type);
+			}
+		}
+
+		for (size_t tileIndex = 0; tileIndex < world.size(); ++tileIndex)
+		{
+			if (world[tileIndex].Type != singleThreadTypes[tileIndex])
+			{
+				fprintf(stderr, "World generated with %u threads differs from the single threaded one at tile %d\n", threadCount, (int)tileIndex);
+				return false;
+			}
+		}
+
+		printf("%10d %10u %16lld %16lld %16.2f\n", generationWorldSize, threadCount, generationTiming.Best, generationTiming.Total / Iterations,
+			generationTiming.Best > 0 ? (double)singleThreadGenBest / generationTiming.Best : 0.0);
+	}
+
+	return true;
+}
+
+/**
+ * Times generation as the palette grows, and checks the sampled frequencies.
+ */
+static bool BenchmarkPaletteSampling()
+{
+	// sampling from the alias table must cost the same whatever the palette size, and match the frequencies
+	const int paletteSizes[] = { 4, 32, 128 };
+	const int paletteWorldSize = 1000;
+	const double FrequencyTolerance = 0.002;
+
+	printf("\n%10s %10s %16s %16s %16s\n", "size", "palette", "Gen best(us)", "Gen avg(us)", "Max freq error");
+
+	for (int paletteSize : paletteSizes)
+	{
+		TiledWorldGenerator paletteWorldGen;
+		paletteWorldGen.Length = paletteWorldSize;
+		paletteWorldGen.Width = paletteWorldSize;
+		paletteWorldGen.CompactWorld = true;
+
+		MakeWidePalette(paletteWorldGen, paletteSize);
+
+		int frequencySum = 0;
+		for (AvailableTile* entryPtr : paletteWorldGen.TilePalette)
+		{
+			frequencySum += entryPtr->Frequency;
+		}
+
+		Timing generationTiming;
+		for (int iteration = 0; iteration < Iterations; ++iteration)
+		{
+			generationTiming.Add(TimeCall([&] { paletteWorldGen.Generate(); }));
+		}
+
+		std::vector<int> entryCounts(paletteSize, 0);
+		for (int cellIndex = 0; cellIndex < paletteWorldSize * paletteWorldSize; ++cellIndex)
+		{
+			++entryCounts[paletteWorldGen.GetCellPaletteIndex(cellIndex / paletteWorldSize, cellIndex % paletteWorldSize)];
+		}
+
+		double maxFrequencyError = 0;
+		for (int paletteIndex = 0; paletteIndex < paletteSize; ++paletteIndex)
+		{
+			const double expected = (double)paletteWorldGen.TilePalette[paletteIndex]->Frequency / frequencySum;
+			const double observed = (double)entryCounts[paletteIndex] / (paletteWorldSize * paletteWorldSize);
+			maxFrequencyError = std::max(maxFrequencyError, std::fabs(observed - expected));
+		}
+
+		if (maxFrequencyError > FrequencyTolerance)
+		{
+			fprintf(stderr, "Generated frequencies are off by %g with %d palette entries\n", maxFrequencyError, paletteSize);
+			return false;
+		}
+
+		printf("%10d %10d %16lld %16lld %16g\n", paletteWorldSize, paletteSize, generationTiming.Best, generationTiming.Total / Iterations, maxFrequencyError);
+	}
+
+	return true;
+}
+
+/**
+ * Checks chunks against a generated world, then times generating chunks of an unbounded world through a bounded cache.
+ */
+static bool BenchmarkChunks()
+{
+	// chunks well inside a generated world must match it exactly, emitters in the neighbouring chunks included
+	const int chunkWorldSize = 6 * TiledWorldGenerator::ChunkSize;
+	TiledWorldGenerator chunkWorldGen;
+	chunkWorldGen.Length = chunkWorldSize;
+	chunkWorldGen.Width = chunkWorldSize;
+	chunkWorldGen.FieldCalculationMode = efmScatter;
+	chunkWorldGen.Generate();
+	chunkWorldGen.CalculateField();
+
+	for (int chunkX = 1; chunkX < 5; ++chunkX)
+	{
+		for (int chunkY = 1; chunkY < 5; ++chunkY)
+		{
+			const WorldChunk& chunk = *chunkWorldGen.GetChunk(chunkX, chunkY);
+
+			for (int x = 0; x < TiledWorldGenerator::ChunkSize; ++x)
+			{
+				for (int y = 0; y < TiledWorldGenerator::ChunkSize; ++y)
+				{
+					const int worldX = (chunkX * TiledWorldGenerator::ChunkSize) + x;
+					const int worldY = (chunkY * TiledWorldGenerator::ChunkSize) + y;
+					const Tile& tile = chunkWorldGen.GetWorld()[(worldX * chunkWorldSize) + worldY];
+					const Vector2f& field = chunk.Fields[(x * TiledWorldGenerator::ChunkSize) + y];
+
+					if (chunk.Palette[(x * TiledWorldGenerator::ChunkSize) + y] != tile.PaletteIndex ||
+						field.X != tile.LocalFieldValue.X || field.Y != tile.LocalFieldValue.Y)
+					{
+						fprintf(stderr, "Chunk %d, %d differs from the generated world at %d, %d\n", chunkX, chunkY, worldX, worldY);
+						return false;
+					}
+				}
+			}
+		}
+	}
+
+	// a chunk's palette indices are bytes, so a palette too large for them gets no chunks rather than wrapped indices
+	TiledWorldGenerator widePaletteWorldGen;
+	MakeWidePalette(widePaletteWorldGen, TiledWorldGenerator::MaxCompactPaletteSize + 1);
+	if (widePaletteWorldGen.GetChunk(0, 0))
+	{
+		fprintf(stderr, "A chunk was generated from %d palette entries\n", (int)widePaletteWorldGen.TilePalette.size());
+		return false;
+	}
+
+	// wandering off in one direction must not grow the cache past its capacity
+	const int ChunkCapacity = 64;
+	const int WanderChunks = 1000;
+	chunkWorldGen.ResetChunks(ChunkCapacity);
+
+	Timing wanderTiming;
+	for (int step = 0; step < WanderChunks; ++step)
+	{
+		wanderTiming.Add(TimeCall([&] { chunkWorldGen.GetChunk(step, -step / 2); }));
+	}
+
+	// going back over the most recent chunks only hits the cache
+	Timing hitTiming;
+	for (int step = WanderChunks - ChunkCapacity; step < WanderChunks; ++step)
+	{
+		hitTiming.Add(TimeCall([&] { chunkWorldGen.GetChunk(step, -step / 2); }));
+	}
+
+	if (chunkWorldGen.GetCachedChunkCount() > ChunkCapacity)
+	{
+		fprintf(stderr, "Chunk cache grew to %d chunks, past its capacity of %d\n", chunkWorldGen.GetCachedChunkCount(), ChunkCapacity);
+		return false;
+	}
+
+	printf("\n%10s %10s %16s %16s %16s %16s\n", "chunk", "visited", "Chunk best(us)", "Chunk avg(us)", "Hit avg(us)", "Cached");
+	printf("%10d %10d %16lld %16lld %16lld %16d\n", TiledWorldGenerator::ChunkSize, WanderChunks, wanderTiming.Best, wanderTiming.Total / WanderChunks,
+		hitTiming.Total / ChunkCapacity, chunkWorldGen.GetCachedChunkCount());
+
+	return true;
+}
+
+/**
+ * Times repainting the world's pixels after edits against repainting all of them.
+ */
+static bool BenchmarkPixels()
+{
+	// the pixels an edit repaints must match repainting the whole world
+	const int PixelWorldSize = 512;
+	const int PixelEdits = 100;
+	TiledWorldGenerator pixelWorldGen;
+	pixelWorldGen.Length = PixelWorldSize;
+	pixelWorldGen.Width = PixelWorldSize;
+	pixelWorldGen.FieldCalculationMode = efmScatter;
+	pixelWorldGen.ShowField = true;
+	pixelWorldGen.Generate();
+	pixelWorldGen.CalculateField();
+
+	int minX, maxX, minY, maxY;
+	Timing fullPixelTiming;
+	fullPixelTiming.Add(TimeCall([&] { pixelWorldGen.UpdateWorldPixels(minX, maxX, minY, maxY); }));
+
+	Timing editPixelTiming;
+	long long dirtyCells = 0;
+	for (int edit = 0; edit < PixelEdits; ++edit)
+	{
+		const int x = (edit * 37) % PixelWorldSize;
+		const int y = (edit * 91) % PixelWorldSize;
+		pixelWorldGen.SetTileType(x, y, *pixelWorldGen.TilePalette[edit % pixelWorldGen.TilePalette.size()]);
+
+		editPixelTiming.Add(TimeCall([&]
+		{
+			if (pixelWorldGen.UpdateWorldPixels(minX, maxX, minY, maxY))
+				dirtyCells += (long long)((maxX - minX) + 1) * ((maxY - minY) + 1);
+		}));
+	}
+
+	const std::vector<ImU32> editedPixels = pixelWorldGen.GetWorldPixels();
+	pixelWorldGen.ShowField = false;
+	pixelWorldGen.UpdateWorldPixels(minX, maxX, minY, maxY);
+	pixelWorldGen.ShowField = true;
+	pixelWorldGen.UpdateWorldPixels(minX, maxX, minY, maxY);
+	if (editedPixels != pixelWorldGen.GetWorldPixels())
+	{
+		fprintf(stderr, "Repainting only the edited pixels differs from repainting the world\n");
+		return false;
+	}
+
+	printf("\n%10s %10s %16s %16s %16s\n", "size", "edits", "Full paint(us)", "Edit paint(us)", "Cells per edit");
+	printf("%10d %10d %16lld %16lld %16lld\n", PixelWorldSize, PixelEdits, fullPixelTiming.Best, editPixelTiming.Total / PixelEdits, dirtyCells / PixelEdits);
+
+	return true;
+}
+
+/**
+ * Times drawing the world from the retained draw cache against rebuilding it every frame.
+ */
+static bool BenchmarkDrawCache()
+{
+	// the cached draw must give exactly the vertices of drawing every cell afresh
+	const int DrawWorldSize = 60;
+	TiledWorldGenerator drawWorldGen;
+	drawWorldGen.Length = DrawWorldSize;
+	drawWorldGen.Width = DrawWorldSize;
+	drawWorldGen.ShowField = true;
+	drawWorldGen.Generate();
+	drawWorldGen.CalculateField();
+	WorldView drawView;
+
+	std::vector<ImDrawVert> vertices;
+	std::vector<ImDrawIdx> indices;
+	std::vector<ImDrawVert> cachedVertices;
+	std::vector<ImDrawIdx> cachedIndices;
+
+	Timing drawTimings[2];
+	for (int cached = 0; cached < 2; ++cached)
+	{
+		drawView.CacheDraw = (cached == 1);
+		for (int frame = 0; frame < DrawFrames; ++frame)
+		{
+			// an edit every so often, so the cache is rebuilt as well as reused
+			if (frame % 25 == 24)
+				drawWorldGen.SetTileType(frame % DrawWorldSize, (frame * 7) % DrawWorldSize, *drawWorldGen.TilePalette[frame % drawWorldGen.TilePalette.size()]);
+
+			DrawFrame(drawWorldGen, drawView, cached ? cachedVertices : vertices, cached ? cachedIndices : indices);
+			drawTimings[cached].Add((long long)drawView.GetDrawTime());
+		}
+	}
+
+	if (vertices.size() != cachedVertices.size() || indices != cachedIndices ||
+		memcmp(vertices.data(), cachedVertices.data(), vertices.size() * sizeof(ImDrawVert)) != 0)
+	{
+		fprintf(stderr, "The cached draw differs from drawing every cell\n");
+		return false;
+	}
+
+	printf("\n%10s %10s %16s %16s %16s %16s\n", "size", "frames", "Direct best(us)", "Direct avg(us)", "Cached best(us)", "Cached avg(us)");
+	printf("%10d %10d %16lld %16lld %16lld %16lld\n", DrawWorldSize, DrawFrames, drawTimings[0].Best, drawTimings[0].Total / DrawFrames,
+		drawTimings[1].Best, drawTimings[1].Total / DrawFrames);
+
+	return true;
+}
+
+/**
+ * Times building and drawing from the mip pyramid of a world far larger than the window.
+ */
+static bool BenchmarkMips()
+{
+	// a world far larger than the window is drawn from its mip pyramid, at a cost set by the window's size
+	TiledWorldGenerator mipWorldGen;
+	mipWorldGen.Length = MipWorldSize;
+	mipWorldGen.Width = MipWorldSize;
+	mipWorldGen.CompactWorld = true;
+	mipWorldGen.Generate();
+	WorldView mipView;
+
+	Timing mipTiming;
+	for (int iteration = 0; iteration < Iterations; ++iteration)
+	{
+		// edit a tile so the pyramid has to be rebuilt
+		mipWorldGen.SetTileType(iteration, iteration, *mipWorldGen.TilePalette[iteration % mipWorldGen.TilePalette.size()]);
+
+		mipTiming.Add(TimeCall([&] { mipView.BuildWorldMips(mipWorldGen); }));
+	}
+
+	// every level 1 texel is the rounded average of its four cells
+	const std::vector<ImU32>& firstMip = mipView.GetWorldMip(1);
+	const int firstMipLength = mipView.GetWorldMipLength(1);
+	for (int x = 0; x < firstMipLength; x += 97)
+	{
+		for (int y = 0; y < mipView.GetWorldMipWidth(1); y += 89)
+		{
+			for (int channel = 0; channel < 4; ++channel)
+			{
+				unsigned channelSum = 0;
+				for (int cell = 0; cell < 4; ++cell)
+				{
+					const ImU32 colour = mipWorldGen.TilePalette[mipWorldGen.GetCellPaletteIndex((x * 2) + (cell / 2), (y * 2) + (cell % 2))]->Colour;
+					channelSum += (colour >> (channel * 8)) & 0xFF;
+				}
+
+				if (((firstMip[(y * firstMipLength) + x] >> (channel * 8)) & 0xFF) != (channelSum + 2) / 4)
+				{
+					fprintf(stderr, "Mip texel %d, %d is not the average of its cells\n", x, y);
+					return false;
+				}
+			}
+		}
+	}
+
+	std::vector<ImDrawVert> vertices;
+	std::vector<ImDrawIdx> indices;
+
+	Timing mipDrawTiming;
+	for (int frame = 0; frame < DrawFrames; ++frame)
+	{
+		DrawFrame(mipWorldGen, mipView, vertices, indices);
+		mipDrawTiming.Add((long long)mipView.GetDrawTime());
+	}
+
+	if (mipView.GetDrawnMipLevel() == 0 || (int)vertices.size() > 65536)
+	{
+		fprintf(stderr, "The large world was drawn at mip level %d with %d vertices\n", mipView.GetDrawnMipLevel(), (int)vertices.size());
+		return false;
+	}
+
+	printf("\n%10s %10s %16s %16s %16s %16s %16s\n", "size", "levels", "Mips best(us)", "Mips avg(us)", "Drawn level", "Draw avg(us)", "Vertices");
+	printf("%10d %10d %16lld %16lld %16d %16lld %16d\n", MipWorldSize, mipView.GetWorldMipCount(), mipTiming.Best, mipTiming.Total / Iterations,
+		mipView.GetDrawnMipLevel(), mipDrawTiming.Total / DrawFrames, (int)vertices.size());
+
+	return true;
+}
+
+/**
+ * Times drawing the chunk view at the largest world size, with the default chunk cache and a tiny one.
+ */
+static bool BenchmarkChunkView()
+{
+	std::vector<ImDrawVert> vertices;
+	std::vector<ImDrawIdx> indices;
+
+	// the chunk view has no camera or mip pyramid, so a view as large as the biggest world is shrunk to what fits the
+	// window's indices and the chunk cache; after the first frame every chunk it draws is a cache hit
+	const int chunkCapacities[] = { ChunkCache::DefaultCapacity, 4 };
+
+	printf("\n%10s %10s %16s %16s %16s %16s\n", "size", "capacity", "Drawn cells", "Vertices", "First draw(us)", "Next draw(us)");
+	for (int chunkCapacity : chunkCapacities)
+	{
+		TiledWorldGenerator chunkViewWorldGen;
+		chunkViewWorldGen.Length = 4096;
+		chunkViewWorldGen.Width = 4096;
+		chunkViewWorldGen.ResetChunks(chunkCapacity);
+		WorldView chunkView;
+		chunkView.ShowChunks = true;
+
+		DrawFrame(chunkViewWorldGen, chunkView, vertices, indices);
+		const float firstDrawTime = chunkView.GetDrawTime();
+		DrawFrame(chunkViewWorldGen, chunkView, vertices, indices);
+
+		if (vertices.empty() || (int)vertices.size() > 65536 || chunkView.GetDrawnCellCount() > WorldView::MaxMipRects ||
+			chunkViewWorldGen.GetCachedChunkCount() > chunkCapacity)
+		{
+			fprintf(stderr, "The chunk view drew %d cells with %d vertices over %d chunks\n", chunkView.GetDrawnCellCount(), (int)vertices.size(),
+				chunkViewWorldGen.GetCachedChunkCount());
+			return false;
+		}
+
+		printf("%10d %10d %16d %16d %16.0f %16.0f\n", chunkViewWorldGen.Length, chunkCapacity, chunkView.GetDrawnCellCount(), (int)vertices.size(),
+			firstDrawTime, chunkView.GetDrawTime());
+	}
+
+	return true;
+}
+
+/**
+ * Times drawing what a zoomed in camera shows of a world far larger than the window.
+ */
+static bool BenchmarkCamera()
+{
+	TiledWorldGenerator mipWorldGen;
+	mipWorldGen.Length = MipWorldSize;
+	mipWorldGen.Width = MipWorldSize;
+	mipWorldGen.CompactWorld = true;
+	mipWorldGen.Generate();
+	WorldView cameraView;
+
+	std::vector<ImDrawVert> vertices;
+	std::vector<ImDrawIdx> indices;
+
+	// zoomed in, only the cells in view are drawn, however large the world
+	printf("\n%10s %10s %16s %16s %16s\n", "size", "zoom", "Drawn cells", "Drawn level", "Draw avg(us)");
+	for (float zoom = 1.0f; zoom <= 64.0f; zoom *= 4.0f)
+	{
+		cameraView.CameraZoom = zoom;
+		cameraView.CameraX = MipWorldSize / 2.0f;
+		cameraView.CameraY = MipWorldSize / 2.0f;
+
+		Timing zoomTiming;
+		for (int frame = 0; frame < DrawFrames; ++frame)
+		{
+			DrawFrame(mipWorldGen, cameraView, vertices, indices);
+			zoomTiming.Add((long long)cameraView.GetDrawTime());
+		}
+
+		// the window is under 1000 pixels a side, so never shows more than about a million pixels' worth of cells
+		if (cameraView.GetDrawnCellCount() > WorldView::MaxMipRects || (int)vertices.size() > 65536)
+		{
+			fprintf(stderr, "Zoomed by %g the world drew %d cells\n", zoom, cameraView.GetDrawnCellCount());
+			return false;
+		}
+
+		printf("%10d %10g %16d %16d %16lld\n", MipWorldSize, zoom, cameraView.GetDrawnCellCount(), cameraView.GetDrawnMipLevel(), zoomTiming.Total / DrawFrames);
+	}
+
+	return true;
+}
+
+#if PROFILER_ENABLED
+/**
+ * Checks the profiler records every threaded pass, and times what its scopes cost.
+ */
+static bool BenchmarkProfiler()
+{
+	// every threaded pass through a profiled scope lands in the profiler, nested under the scope that started it
+	const int ProfileWorldSize = 512;
+	TiledWorldGenerator profileWorldGen;
+	profileWorldGen.Length = ProfileWorldSize;
+	profileWorldGen.Width = ProfileWorldSize;
+	profileWorldGen.Generate();
+	profileWorldGen.CalculateField();
+	Profiler::Instance().Collect();
+
+	Timing fieldTiming;
+	for (int iteration = 0; iteration < Iterations; ++iteration)
+	{
+		fieldTiming.Add(TimeCall([&] { profileWorldGen.CalculateField(); }));
+	}
+	Profiler::Instance().Collect();
+
+	const int gatherZone = Profiler::Instance().FindZone("GatherField");
+	const int rowsZone = Profiler::Instance().FindZone("GatherRows");
+	const int rowTasks = (ProfileWorldSize + TiledWorldGenerator::FieldRowsPerTask - 1) / TiledWorldGenerator::FieldRowsPerTask;
+	if (gatherZone < 0 || rowsZone < 0 || Profiler::Instance().Summarise(rowsZone).Samples < std::min(rowTasks * Iterations, (int)Profiler::HistorySize))
+	{
+		fprintf(stderr, "The profiler is missing the gather passes\n");
+		return false;
+	}
+
+	// the cost of a scope on its own, collected often enough that nothing is dropped
+	const int EmptyScopes = 1000000;
+	high_resolution_clock::time_point scopeStart = high_resolution_clock::now();
+	for (int scope = 0; scope < EmptyScopes; ++scope)
+	{
+		PROFILE_SCOPE("Empty scope");
+		if (scope % 1024 == 1023)
+			Profiler::Instance().Collect();
+	}
+	const double scopeNanoseconds = (double)duration_cast<nanoseconds>(high_resolution_clock::now() - scopeStart).count() / EmptyScopes;
+
+	// a field pass records its own scope, the gather's, and one per block of rows
+	const ProfileSummary rowsSummary = Profiler::Instance().Summarise(rowsZone);
+	const double overhead = ((rowTasks + 2) * scopeNanoseconds) / (fieldTiming.Best * 1000.0);
+
+	printf("\n%10s %10s %16s %16s %16s %16s %16s\n", "size", "scopes", "Scope cost(ns)", "Field best(us)", "Overhead", "Rows p95(us)", "Rows p99(us)");
+	printf("%10d %10d %16.1f %16lld %15.4f%% %16.1f %16.1f\n", ProfileWorldSize, rowTasks + 2, scopeNanoseconds, fieldTiming.Best, overhead * 100.0,
+		rowsSummary.P95, rowsSummary.P99);
+
+	if (overhead > 0.01)
+	{
+		fprintf(stderr, "Profiling costs %.2f%% of a field pass\n", overhead * 100.0);
+		return false;
+	}
+
+	return true;
+}
+#endif
+
+int main(int argc, char** argv)
+{
+	if (argc > 1 && std::string(argv[1]) == "--matrix")
+		return RunMatrix(argc, argv);
+
+	// each area prints its own tables, and the run stops at the first one whose results are wrong
+	bool (*const benchmarks[])() =
+	{
+		BenchmarkTreeBuilds,
+		BenchmarkTreeQueries,
+		BenchmarkGatherKernels,
+		BenchmarkConvolution,
+		BenchmarkLayers,
+		BenchmarkAggregateExact,
+		BenchmarkAggregateApproximation,
+		BenchmarkAggregateDense,
+		BenchmarkFieldThreads,
+		BenchmarkPatching,
+		BenchmarkCompactWorld,
+		BenchmarkGenerationThreads,
+		BenchmarkPaletteSampling,
+		BenchmarkChunks,
+		BenchmarkPixels,
+		BenchmarkDrawCache,
+		BenchmarkMips,
+		BenchmarkChunkView,
+		BenchmarkCamera,
+#if PROFILER_ENABLED
+		BenchmarkProfiler,
+#endif
+	};
+
+	for (bool (*benchmark)() : benchmarks)
+	{
+		if (!benchmark())
+			return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,96 @@
+#include "ChunkCache.h"
+#include <algorithm>
+
+ChunkCache::ChunkCache(int capacity)
+{
+	SetCapacity(capacity);
+}
+
+WorldChunk* ChunkCache::Find(int chunkX, int chunkY)
+{
+	auto chunkIt = lookup.find(Key(chunkX, chunkY));
+	if (chunkIt == lookup.end())
+		return nullptr;
+
+	const int slot = chunkIt->second;
+	if (slot != mostRecent)
+	{
+		Unlink(slot);
+		PushFront(slot);
+	}
+
+	return &chunks[slot];
+}
+
+WorldChunk& ChunkCache::Insert(int chunkX, int chunkY)
+{
+	// use a fresh slot while there are any, then recycle the least recently used one
+	int slot;
+	if (usedSlots < (int)chunks.size())
+	{
+		slot = usedSlots++;
+	}
+	else
+	{
+		slot = leastRecent;
+		Unlink(slot);
+		lookup.erase(Key(chunks[slot].ChunkX, chunks[slot].ChunkY));
+	}
+
+	WorldChunk& chunk = chunks[slot];
+	chunk.ChunkX = chunkX;
+	chunk.ChunkY = chunkY;
+	chunk.LargestFieldStrength = 0;
+
+	lookup[Key(chunkX, chunkY)] = slot;
+	PushFront(slot);
+
+	return chunk;
+}
+
+void ChunkCache::Clear()
+{
+	lookup.clear();
+	usedSlots = 0;
+	mostRecent = -1;
+	leastRecent = -1;
+}
+
+void ChunkCache::SetCapacity(int capacity)
+{
+	Clear();
+	chunks.clear();
+	chunks.resize(std::max(capacity, 1));
+}
+
+void ChunkCache::Unlink(int slot)
+{
+	WorldChunk& chunk = chunks[slot];
+
+	if (chunk.Previous >= 0)
+		chunks[chunk.Previous].Next = chunk.Next;
+	else
+		mostRecent = chunk.Next;
+
+	if (chunk.Next >= 0)
+		chunks[chunk.Next].Previous = chunk.Previous;
+	else
+		leastRecent = chunk.Previous;
+
+	chunk.Previous = -1;
+	chunk.Next = -1;
+}
+
+void ChunkCache::PushFront(int slot)
+{
+	WorldChunk& chunk = chunks[slot];
+	chunk.Previous = -1;
+	chunk.Next = mostRecent;
+
+	if (mostRecent >= 0)
+		chunks[mostRecent].Previous = slot;
+	mostRecent = slot;
+
+	if (leastRecent < 0)
+		leastRecent = slot;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "Vector.h"
+
+/**
+ * A square block of a chunked world, stored compactly as a palette index and a field per cell, laid out as
+ * x * ChunkSize + y from the chunk's first cell.
+ */
+struct WorldChunk
+{
+	int ChunkX = 0;
+	int ChunkY = 0;
+	std::vector<uint8_t> Palette;
+	std::vector<Vector2f> Fields;
+	float LargestFieldStrength = 0;
+
+	// neighbours in the least recently used list, as slot indices
+	int Previous = -1;
+	int Next = -1;
+};
+
+/**
+ * Bounded least recently used cache of world chunks, keyed by chunk coordinate. The slots are allocated once, and
+ * a full cache hands back its least recently used slot for reuse, so memory stays flat however much of the world
+ * is visited. Not thread safe.
+ */
+class ChunkCache
+{
+public:
+	/**
+	 * Creates an empty cache.
+	 *
+	 * @param capacity The most chunks to keep.
+	 */
+	explicit ChunkCache(int capacity = DefaultCapacity);
+
+	/**
+	 * Finds a chunk, marking it as the most recently used.
+	 *
+	 * @param chunkX The x coordinate of the chunk.
+	 * @param chunkY The y coordinate of the chunk.
+	 *
+	 * @return The chunk, or nullptr if it is not cached. It stays valid until the next Insert.
+	 */
+	WorldChunk* Find(int chunkX, int chunkY);
+
+	/**
+	 * Makes room for a chunk that is not cached, evicting the least recently used one if the cache is full.
+	 * The slot keeps the storage of whatever it held before, so the caller only has to overwrite it.
+	 *
+	 * @param chunkX The x coordinate of the chunk.
+	 * @param chunkY The y coordinate of the chunk.
+	 *
+	 * @return The slot for the chunk, marked as the most recently used.
+	 */
+	WorldChunk& Insert(int chunkX, int chunkY);
+
+	/**
+	 * Forgets every chunk, keeping the slots' storage.
+	 */
+	void Clear();
+
+	/**
+	 * Changes the capacity, forgetting every chunk.
+	 *
+	 * @param capacity The most chunks to keep.
+	 */
+	void SetCapacity(int capacity);
+
+	int Size() const { return static_cast<int>(lookup.size()); }
+	int Capacity() const { return static_cast<int>(chunks.size()); }
+
+public:
+	static const int DefaultCapacity = 256;
+
+protected:
+	void Unlink(int slot);
+	void PushFront(int slot);
+
+	static uint64_t Key(int chunkX, int chunkY)
+	{
+		return (static_cast<uint64_t>(static_cast<uint32_t>(chunkX)) << 32) | static_cast<uint32_t>(chunkY);
+	}
+
+protected:
+	std::vector<WorldChunk> chunks;
+	std::unordered_map<uint64_t, int> lookup;
+	int usedSlots = 0;
+	int mostRecent = -1;
+	int leastRecent = -1;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Philox 4x32-10 counter based random number generator (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+ * Every block of four random words is a pure function of a 128 bit counter and a 64 bit key, so any block can be
+ * generated on any thread, in any order, with no state to share or advance. Only 32 bit multiplies, xors and adds
+ * are used, so the results are the same on every platform.
+ */
+class CounterRandom
+{
+public:
+	/**
+	 * Generates the block of random words for a counter.
+	 *
+	 * @param key The key, usually the seed.
+	 * @param counter0 The first word of the counter.
+	 * @param counter1 The second word of the counter.
+	 * @param counter2 The third word of the counter.
+	 * @param counter3 The fourth word of the counter.
+	 * @param result Receives the four random words.
+	 */
+	static inline void Generate(uint64_t key, uint32_t counter0, uint32_t counter1, uint32_t counter2, uint32_t counter3, uint32_t result[4])
+	{
+		uint32_t key0 = static_cast<uint32_t>(key);
+		uint32_t key1 = static_cast<uint32_t>(key >> 32);
+
+		for (int round = 0; round < Rounds; ++round)
+		{
+			const uint64_t product0 = static_cast<uint64_t>(Multiplier0) * counter0;
+			const uint64_t product1 = static_cast<uint64_t>(Multiplier1) * counter2;
+
+			counter0 = static_cast<uint32_t>(product1 >> 32) ^ counter1 ^ key0;
+			counter1 = static_cast<uint32_t>(product1);
+			counter2 = static_cast<uint32_t>(product0 >> 32) ^ counter3 ^ key1;
+			counter3 = static_cast<uint32_t>(product0);
+
+			key0 += KeyStep0;
+			key1 += KeyStep1;
+		}
+
+		result[0] = counter0;
+		result[1] = counter1;
+		result[2] = counter2;
+		result[3] = counter3;
+	}
+
+	/**
+	 * Converts a random word to a float in [0, 1), using its top 24 bits so every value is exactly representable.
+	 *
+	 * @param value The random word.
+	 *
+	 * @return The float.
+	 */
+	static inline float ToUnitFloat(uint32_t value)
+	{
+		return static_cast<float>(value >> 8) * (1.0f / 16777216.0f);
+	}
+
+public:
+	static const int Rounds = 10;
+
+protected:
+	static const uint32_t Multiplier0 = 0xD2511F53;
+	static const uint32_t Multiplier1 = 0xCD9E8D57;
+	static const uint32_t KeyStep0 = 0x9E3779B9;
+	static const uint32_t KeyStep1 = 0xBB67AE85;
+};
@@ -0,0 +1,261 @@
+#include "FieldAggregateTree.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace
+{
+	struct KeyedEmitter
+	{
+		uint64_t Key;
+		int X;
+		int Y;
+	};
+
+	uint64_t SpreadBits(uint32_t value)
+	{
+		uint64_t spread = value;
+		spread = (spread | (spread << 16)) & 0x0000FFFF0000FFFFull;
+		spread = (spread | (spread << 8)) & 0x00FF00FF00FF00FFull;
+		spread = (spread | (spread << 4)) & 0x0F0F0F0F0F0F0F0Full;
+		spread = (spread | (spread << 2)) & 0x3333333333333333ull;
+		spread = (spread | (spread << 1)) & 0x5555555555555555ull;
+		return spread;
+	}
+}
+
+const float FieldAggregateTree::StraddleFraction = 0.1f;
+
+void FieldAggregateTree::Build(const std::vector<Tile>& world, int length, int width)
+{
+	groups.clear();
+
+	std::vector<std::vector<int>> groupXs;
+	std::vector<std::vector<int>> groupYs;
+	int groupIndex = -1;
+	for (int x = 0; x < length; ++x)
+	{
+		for (int y = 0; y < width; ++y)
+		{
+			const Tile& tile = world[(x * width) + y];
+			if (!tile.EmitsField())
+				continue;
+
+			// neighbouring emitters are usually of the same group, so check the last one first
+			if (groupIndex < 0 || groups[groupIndex].FieldStrength != tile.FieldStrength || groups[groupIndex].FieldRange != tile.FieldRange)
+			{
+				groupIndex = 0;
+				while (groupIndex < (int)groups.size() && (groups[groupIndex].FieldStrength != tile.FieldStrength || groups[groupIndex].FieldRange != tile.FieldRange))
+				{
+					++groupIndex;
+				}
+
+				if (groupIndex == (int)groups.size())
+				{
+					groups.push_back({ tile.FieldStrength, tile.FieldRange, {} });
+					groupXs.emplace_back();
+					groupYs.emplace_back();
+				}
+			}
+
+			groupXs[groupIndex].push_back(x);
+			groupYs[groupIndex].push_back(y);
+		}
+	}
+
+	for (size_t index = 0; index < groups.size(); ++index)
+	{
+		BuildGroup(groups[index], groupXs[index], groupYs[index]);
+	}
+}
+
+void FieldAggregateTree::BuildGroup(EmitterGroup& group, std::vector<int>& emitterXs, std::vector<int>& emitterYs)
+{
+	// in Morton order the emitters below every node are next to each other, at every level
+	std::vector<KeyedEmitter> emitters(emitterXs.size());
+	for (size_t index = 0; index < emitters.size(); ++index)
+	{
+		emitters[index] = { SpreadBits((uint32_t)emitterXs[index]) | (SpreadBits((uint32_t)emitterYs[index]) << 1), emitterXs[index], emitterYs[index] };
+	}
+	std::vector<int>().swap(emitterXs);
+	std::vector<int>().swap(emitterYs);
+	std::sort(emitters.begin(), emitters.end(), [](const KeyedEmitter& a, const KeyedEmitter& b) { return a.Key < b.Key; });
+
+	std::vector<uint64_t> keys(emitters.size());
+	std::vector<double> sumXs(emitters.size());
+	std::vector<double> sumYs(emitters.size());
+	group.Levels.assign(1, std::vector<AggregateNode>(emitters.size()));
+	for (size_t index = 0; index < emitters.size(); ++index)
+	{
+		keys[index] = emitters[index].Key;
+		sumXs[index] = emitters[index].X;
+		sumYs[index] = emitters[index].Y;
+		group.Levels[0][index] = { 1.0f, (float)emitters[index].X, (float)emitters[index].Y, -1 };
+	}
+	std::vector<KeyedEmitter>().swap(emitters);
+
+	// merge runs of children with the same parent until a single node is left
+	while (group.Levels.back().size() > 1)
+	{
+		std::vector<AggregateNode> parents;
+		std::vector<uint64_t> parentKeys;
+		std::vector<double> parentSumXs;
+		std::vector<double> parentSumYs;
+
+		const std::vector<AggregateNode>& children = group.Levels.back();
+		for (size_t childIndex = 0; childIndex < children.size(); ++childIndex)
+		{
+			const uint64_t parentKey = keys[childIndex] >> 2;
+			if (parentKeys.empty() || parentKeys.back() != parentKey)
+			{
+				parents.push_back({ 0.0f, 0.0f, 0.0f, (int)childIndex });
+				parentKeys.push_back(parentKey);
+				parentSumXs.push_back(0);
+				parentSumYs.push_back(0);
+			}
+
+			// the sums are of whole tile coordinates, so in double they are exact
+			parents.back().Count += children[childIndex].Count;
+			parentSumXs.back() += sumXs[childIndex];
+			parentSumYs.back() += sumYs[childIndex];
+		}
+
+		for (size_t parentIndex = 0; parentIndex < parents.size(); ++parentIndex)
+		{
+			parents[parentIndex].X = (float)(parentSumXs[parentIndex] / parents[parentIndex].Count);
+			parents[parentIndex].Y = (float)(parentSumYs[parentIndex] / parents[parentIndex].Count);
+		}
+
+		keys.swap(parentKeys);
+		sumXs.swap(parentSumXs);
+		sumYs.swap(parentSumYs);
+		group.Levels.push_back(std::move(parents));
+	}
+}
+
+void FieldAggregateTree::CalculateFieldBlock(int firstX, int endX, int firstY, int endY, float openingAngle, std::vector<Vector2f>& field) const
+{
+	const int blockWidth = endY - firstY;
+	field.assign((endX - firstX) * blockWidth, Vector2f::Zero);
+
+	const float blockMinX = (float)firstX;
+	const float blockMaxX = (float)(endX - 1);
+	const float blockMinY = (float)firstY;
+	const float blockMaxY = (float)(endY - 1);
+	const float openingAngleSquared = openingAngle * openingAngle;
+
+	struct PendingNode
+	{
+		int Level;
+		int Index;
+	};
+
+	struct PseudoEmitter
+	{
+		float X;
+		float Y;
+		float FieldStrength;
+	};
+
+	std::vector<PseudoEmitter> emitters;
+	for (const EmitterGroup& group : groups)
+	{
+		const float rangeSquared = group.FieldRange * group.FieldRange;
+
+		// walk the tree once for the whole block, keeping the nodes every receiver in it can take as they are
+		emitters.clear();
+
+		// depth first, each level pushes at most four nodes
+		PendingNode pending[4 * 64];
+		int pendingCount = 0;
+		pending[pendingCount++] = { (int)group.Levels.size() - 1, 0 };
+
+		while (pendingCount > 0)
+		{
+			const PendingNode node = pending[--pendingCount];
+			const std::vector<AggregateNode>& nodes = group.Levels[node.Level];
+			const AggregateNode& aggregate = nodes[node.Index];
+
+			// the square the node covers, distances are compared squared to save the square roots
+			const int size = 1 << node.Level;
+			const float minX = (float)(((int)aggregate.X >> node.Level) << node.Level);
+			const float minY = (float)(((int)aggregate.Y >> node.Level) << node.Level);
+			const float maxX = minX + (float)(size - 1);
+			const float maxY = minY + (float)(size - 1);
+
+			const float gapX = std::max(std::max(minX - blockMaxX, blockMinX - maxX), 0.0f);
+			const float gapY = std::max(std::max(minY - blockMaxY, blockMinY - maxY), 0.0f);
+			if ((gapX * gapX) + (gapY * gapY) >= rangeSquared)
+				continue;
+
+			// a lone emitter is exact wherever it is
+			if (aggregate.Count == 1)
+			{
+				emitters.push_back({ aggregate.X, aggregate.Y, group.FieldStrength });
+				continue;
+			}
+
+			// the node must look small from the nearest receiver, and can't hold any of them; past the range the falloff
+			// bends, so a node that some receivers only partly reach has to be small against the range as well
+			const float nearX = std::max(std::max(blockMinX - aggregate.X, aggregate.X - blockMaxX), 0.0f);
+			const float nearY = std::max(std::max(blockMinY - aggregate.Y, aggregate.Y - blockMaxY), 0.0f);
+			const float farX = std::max(blockMaxX - minX, maxX - blockMinX);
+			const float farY = std::max(blockMaxY - minY, maxY - blockMinY);
+			const bool straddlesRange = (farX * farX) + (farY * farY) >= rangeSquared;
+			if ((gapX > 0 || gapY > 0) && (!straddlesRange || (float)size < StraddleFraction * group.FieldRange) &&
+				(float)(size * size) < openingAngleSquared * ((nearX * nearX) + (nearY * nearY)))
+			{
+				emitters.push_back({ aggregate.X, aggregate.Y, aggregate.Count * group.FieldStrength });
+				continue;
+			}
+
+			const std::vector<AggregateNode>& children = group.Levels[node.Level - 1];
+			const int endChild = (node.Index + 1 < (int)nodes.size()) ? nodes[node.Index + 1].FirstChild : (int)children.size();
+			for (int childIndex = aggregate.FirstChild; childIndex < endChild; ++childIndex)
+			{
+				pending[pendingCount++] = { node.Level - 1, childIndex };
+			}
+		}
+
+		// within range the field is the strength times v * (1 / d - 1 / range), the receiver's own emission is skipped
+		const float inverseRange = 1.0f / group.FieldRange;
+		for (int x = firstX; x < endX; ++x)
+		{
+			for (int y = firstY; y < endY; ++y)
+			{
+				float fieldX = 0;
+				float fieldY = 0;
+				for (const PseudoEmitter& emitter : emitters)
+				{
+					const float vecX = (float)x - emitter.X;
+					const float vecY = (float)y - emitter.Y;
+					const float distanceSquared = (vecX * vecX) + (vecY * vecY);
+					if (distanceSquared == 0 || distanceSquared >= rangeSquared)
+						continue;
+
+					const float scale = emitter.FieldStrength * ((1.0f / std::sqrt(distanceSquared)) - inverseRange);
+					fieldX += vecX * scale;
+					fieldY += vecY * scale;
+				}
+
+				Vector2f& receiverField = field[((x - firstX) * blockWidth) + (y - firstY)];
+				receiverField.X += fieldX;
+				receiverField.Y += fieldY;
+			}
+		}
+	}
+}
+
+size_t FieldAggregateTree::GetNodeCount() const
+{
+	size_t nodeCount = 0;
+	for (const EmitterGroup& group : groups)
+	{
+		for (const std::vector<AggregateNode>& nodes : group.Levels)
+		{
+			nodeCount += nodes.size();
+		}
+	}
+
+	return nodeCount;
+}
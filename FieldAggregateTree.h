@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include "Tile.h"
+
+/**
+ * Sparse quadtree over the tile grid for approximating the field Barnes-Hut style. Emitters are grouped by their
+ * strength and range, and each group has a tree of its own holding only the nodes with emitters below them: level 0
+ * is the emitters themselves, and every node above covers a 2^level square of tiles and holds the number of emitters
+ * below it and their centroid. A node's emitters are treated as one pseudo emitter at their centroid, with their
+ * summed strength, when the node is small compared to its distance. The first order errors of the pseudo emitter
+ * cancel about the centroid, and the falloff reaches zero at the range, so small nodes straddling it are approximated too.
+ */
+class FieldAggregateTree
+{
+public:
+	/**
+	 * Rebuilds the tree. The world must stay unchanged while the tree is in use.
+	 *
+	 * @param world The tiles, laid out as x * width + y.
+	 * @param length The number of tiles along x.
+	 * @param width The number of tiles along y.
+	 */
+	void Build(const std::vector<Tile>& world, int length, int width);
+
+	/**
+	 * Approximates the field of a block of tiles, walking the tree once for all of them. A node is approximated only
+	 * if it is small compared to its distance from every tile in the block. An opening angle of 0 never approximates,
+	 * so gives the exact field (up to rounding).
+	 *
+	 * @param firstX The x coordinate of the first tile in the block.
+	 * @param endX One past the x coordinate of the last tile in the block.
+	 * @param firstY The y coordinate of the first tile in the block.
+	 * @param endY One past the y coordinate of the last tile in the block.
+	 * @param openingAngle The largest ratio of node size to distance at which a node is approximated.
+	 * @param field Receives the field of each tile, laid out as (x - firstX) * (endY - firstY) + (y - firstY), ignoring
+	 *              the tile's own emission.
+	 */
+	void CalculateFieldBlock(int firstX, int endX, int firstY, int endY, float openingAngle, std::vector<Vector2f>& field) const;
+
+	/**
+	 * Gets the number of nodes in the trees of every group, emitters included.
+	 */
+	size_t GetNodeCount() const;
+
+public:
+	/** Nodes straddling the range of some of the receivers are only approximated if smaller than this times the range. */
+	static const float StraddleFraction;
+
+protected:
+	struct AggregateNode
+	{
+		// a centroid always lies within its node, so the node's square is found from it
+		float Count;
+		float X;
+		float Y;
+		int FirstChild;
+	};
+
+	struct EmitterGroup
+	{
+		float FieldStrength;
+		float FieldRange;
+
+		// levels[level] holds the nodes of a level, children are contiguous and in the same order as their parents
+		std::vector<std::vector<AggregateNode>> Levels;
+	};
+
+	void BuildGroup(EmitterGroup& group, std::vector<int>& emitterXs, std::vector<int>& emitterYs);
+
+protected:
+	std::vector<EmitterGroup> groups;
+};
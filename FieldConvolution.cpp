@@ -0,0 +1,328 @@
+#include "FieldConvolution.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+
+const float FieldConvolution::Tolerance = 1e-5f;
+
+/** Lines are transformed in batches of this many per task. */
+static const int LinesPerTask = 16;
+
+// std::complex multiplication checks for infinities and NaNs, which is a lot slower than the plain formula
+static inline std::complex<double> Multiply(const std::complex<double>& a, const std::complex<double>& b)
+{
+	return std::complex<double>((a.real() * b.real()) - (a.imag() * b.imag()), (a.real() * b.imag()) + (a.imag() * b.real()));
+}
+
+void FieldConvolution::Calculate(int length, int width, const std::vector<const FieldStencil*>& cellStencils, std::vector<Vector2f>& field, ThreadPool& pool)
+{
+	field.assign(length * width, Vector2f::Zero);
+
+	// find the distinct stencils in use, in the order they are first seen
+	std::vector<const FieldStencil*> stencils;
+	int maxReach = 0;
+	for (const FieldStencil* stencilPtr : cellStencils)
+	{
+		if (!stencilPtr || stencilPtr->Radius <= 0 || std::find(stencils.begin(), stencils.end(), stencilPtr) != stencils.end())
+			continue;
+
+		stencils.push_back(stencilPtr);
+		maxReach = std::max(maxReach, stencilPtr->Radius);
+	}
+
+	if (stencils.empty())
+		return;
+
+	// pad the grid so the field of an emitter near one edge can't wrap around onto the other
+	const int newLength = SmoothSize(length + maxReach);
+	const int newWidth = SmoothSize(width + maxReach);
+	if (newLength != paddedLength || newWidth != paddedWidth)
+	{
+		InvalidateSpectra();
+
+		paddedLength = newLength;
+		paddedWidth = newWidth;
+		lengthPlan.Prepare(paddedLength);
+		widthPlan.Prepare(paddedWidth);
+	}
+
+	const size_t binCount = static_cast<size_t>(paddedLength) * paddedWidth;
+	fieldSpectrum.assign(binCount, Bin(0));
+
+	lineBuffers.resize(pool.ThreadCount());
+	for (std::vector<Sample>& lineBuffer : lineBuffers)
+	{
+		lineBuffer.resize(2 * std::max(paddedLength, paddedWidth));
+	}
+
+	// the masks are real, so two of them are transformed at once as the real and imaginary parts
+	for (size_t pairIndex = 0; pairIndex < stencils.size(); pairIndex += 2)
+	{
+		const FieldStencil* stencilA = stencils[pairIndex];
+		const FieldStencil* stencilB = (pairIndex + 1 < stencils.size()) ? stencils[pairIndex + 1] : nullptr;
+
+		const std::vector<Bin>& spectrumA = GetSpectrum(*stencilA, pool);
+		const std::vector<Bin>* spectrumB = stencilB ? &GetSpectrum(*stencilB, pool) : nullptr;
+
+		maskSpectrum.assign(binCount, Bin(0));
+		for (int x = 0; x < length; ++x)
+		{
+			for (int y = 0; y < width; ++y)
+			{
+				const FieldStencil* stencilPtr = cellStencils[(x * width) + y];
+				if (stencilPtr == stencilA)
+					maskSpectrum[(x * paddedWidth) + y] = Bin(1, 0);
+				else if (stencilB && stencilPtr == stencilB)
+					maskSpectrum[(x * paddedWidth) + y] = Bin(0, 1);
+			}
+		}
+
+		// only the first length rows of the mask can be non zero
+		Transform2D(maskSpectrum, false, length, pool);
+
+		// split the two mask spectra apart using their symmetry, and add each times its kernel to the field
+		pool.ParallelFor(paddedLength, [this, &spectrumA, spectrumB](int x, unsigned)
+		{
+			const int mirrorX = (paddedLength - x) % paddedLength;
+			for (int y = 0; y < paddedWidth; ++y)
+			{
+				const int mirrorY = (paddedWidth - y) % paddedWidth;
+				const size_t binIndex = (static_cast<size_t>(x) * paddedWidth) + y;
+
+				const Sample packed(maskSpectrum[binIndex]);
+				const Sample mirror = std::conj(Sample(maskSpectrum[(static_cast<size_t>(mirrorX) * paddedWidth) + mirrorY]));
+
+				Sample sum = Multiply((packed + mirror) * 0.5, Sample(spectrumA[binIndex]));
+				if (spectrumB)
+					sum += Multiply(Multiply(packed - mirror, Sample(0, -0.5)), Sample((*spectrumB)[binIndex]));
+
+				fieldSpectrum[binIndex] += Bin(sum);
+			}
+		});
+	}
+
+	// only the first length rows of the result are in the world
+	Transform2D(fieldSpectrum, true, length, pool);
+
+	const double scale = 1.0 / static_cast<double>(binCount);
+	for (int x = 0; x < length; ++x)
+	{
+		for (int y = 0; y < width; ++y)
+		{
+			const Bin& bin = fieldSpectrum[(x * paddedWidth) + y];
+			field[(x * width) + y] = Vector2f(static_cast<float>(bin.real() * scale), static_cast<float>(bin.imag() * scale));
+		}
+	}
+}
+
+void FieldConvolution::InvalidateSpectra()
+{
+	for (KernelSpectrum* spectrumPtr : spectra)
+	{
+		delete spectrumPtr;
+	}
+	spectra.clear();
+}
+
+void FieldConvolution::InvalidateSpectra(float fieldStrength, float fieldRange)
+{
+	spectra.erase(std::remove_if(spectra.begin(), spectra.end(), [fieldStrength, fieldRange](KernelSpectrum* spectrumPtr)
+	{
+		if (spectrumPtr->FieldStrength != fieldStrength || spectrumPtr->FieldRange != fieldRange)
+			return false;
+
+		delete spectrumPtr;
+		return true;
+	}), spectra.end());
+}
+
+int FieldConvolution::SmoothSize(int minimum)
+{
+	for (int size = std::max(minimum, 1); ; ++size)
+	{
+		int remainder = size;
+		for (int factor : { 2, 3, 5 })
+		{
+			while (remainder % factor == 0)
+				remainder /= factor;
+		}
+
+		if (remainder == 1)
+			return size;
+	}
+}
+
+void FieldConvolution::Plan::Prepare(int size)
+{
+	Size = size;
+
+	Factors.clear();
+	for (int factor : { 4, 2, 3, 5 })
+	{
+		while (size % factor == 0)
+		{
+			Factors.push_back(factor);
+			size /= factor;
+		}
+	}
+
+	const double pi = 3.14159265358979323846;
+	Twiddles.resize(Size);
+	InverseTwiddles.resize(Size);
+	for (int index = 0; index < Size; ++index)
+	{
+		Twiddles[index] = std::polar(1.0, -2.0 * pi * index / Size);
+		InverseTwiddles[index] = std::conj(Twiddles[index]);
+	}
+}
+
+const std::vector<FieldConvolution::Bin>& FieldConvolution::GetSpectrum(const FieldStencil& stencil, ThreadPool& pool)
+{
+	for (KernelSpectrum* spectrumPtr : spectra)
+	{
+		if (spectrumPtr->FieldStrength == stencil.FieldStrength && spectrumPtr->FieldRange == stencil.FieldRange && spectrumPtr->Radius == stencil.Radius)
+			return spectrumPtr->Bins;
+	}
+
+	KernelSpectrum* spectrumPtr = new KernelSpectrum();
+	spectrumPtr->FieldStrength = stencil.FieldStrength;
+	spectrumPtr->FieldRange = stencil.FieldRange;
+	spectrumPtr->Radius = stencil.Radius;
+
+	// the kernel is centred on the origin, so negative offsets wrap around to the far end of the grid
+	std::vector<Bin>& bins = spectrumPtr->Bins;
+	bins.assign(static_cast<size_t>(paddedLength) * paddedWidth, Bin(0));
+	for (int offsetX = -stencil.Radius; offsetX <= stencil.Radius; ++offsetX)
+	{
+		for (int offsetY = -stencil.Radius; offsetY <= stencil.Radius; ++offsetY)
+		{
+			const Vector2f& value = stencil.At(offsetX, offsetY);
+			const int x = (offsetX + paddedLength) % paddedLength;
+			const int y = (offsetY + paddedWidth) % paddedWidth;
+			bins[(static_cast<size_t>(x) * paddedWidth) + y] = Bin(value.X, value.Y);
+		}
+	}
+
+	Transform2D(bins, false, paddedLength, pool);
+
+	spectra.push_back(spectrumPtr);
+	return bins;
+}
+
+void FieldConvolution::Transform2D(std::vector<Bin>& grid, bool inverse, int rowCount, ThreadPool& pool)
+{
+	// rows past rowCount are either all zero going in or not needed coming out, so they can be skipped
+	if (!inverse)
+	{
+		TransformLines(grid, widthPlan, rowCount, paddedWidth, 1, false, pool);
+		TransformLines(grid, lengthPlan, paddedWidth, 1, paddedWidth, false, pool);
+	}
+	else
+	{
+		TransformLines(grid, lengthPlan, paddedWidth, 1, paddedWidth, true, pool);
+		TransformLines(grid, widthPlan, rowCount, paddedWidth, 1, true, pool);
+	}
+}
+
+void FieldConvolution::TransformLines(std::vector<Bin>& grid, const Plan& plan, int lineCount, int lineStep, int sampleStep, bool inverse, ThreadPool& pool)
+{
+	const int taskCount = (lineCount + LinesPerTask - 1) / LinesPerTask;
+	pool.ParallelFor(taskCount, [this, &grid, &plan, lineCount, lineStep, sampleStep, inverse](int taskIndex, unsigned threadIndex)
+	{
+		Sample* input = lineBuffers[threadIndex].data();
+		Sample* output = input + plan.Size;
+
+		const int endLine = std::min((taskIndex + 1) * LinesPerTask, lineCount);
+		for (int line = taskIndex * LinesPerTask; line < endLine; ++line)
+		{
+			Bin* samples = grid.data() + (static_cast<size_t>(line) * lineStep);
+			for (int index = 0; index < plan.Size; ++index)
+			{
+				input[index] = Sample(samples[static_cast<size_t>(index) * sampleStep]);
+			}
+
+			Transform(plan, input, 1, plan.Size, output, 0, inverse);
+
+			for (int index = 0; index < plan.Size; ++index)
+			{
+				samples[static_cast<size_t>(index) * sampleStep] = Bin(output[index]);
+			}
+		}
+	});
+}
+
+void FieldConvolution::Transform(const Plan& plan, const Sample* input, int inputStride, int size, Sample* output, int factorIndex, bool inverse)
+{
+	if (size == 1)
+	{
+		output[0] = input[0];
+		return;
+	}
+
+	const int radix = plan.Factors[factorIndex];
+	const int subSize = size / radix;
+	const int twiddleStep = plan.Size / size;
+	const Sample* twiddles = inverse ? plan.InverseTwiddles.data() : plan.Twiddles.data();
+
+	// transform every radix-th sample, starting from each offset, into consecutive blocks of the output
+	for (int offset = 0; offset < radix; ++offset)
+	{
+		Transform(plan, input + (offset * inputStride), inputStride * radix, subSize, output + (offset * subSize), factorIndex + 1, inverse);
+	}
+
+	// then combine the blocks with a radix point DFT for each frequency
+	Sample terms[5];
+	for (int frequency = 0; frequency < subSize; ++frequency)
+	{
+		terms[0] = output[frequency];
+		for (int offset = 1; offset < radix; ++offset)
+		{
+			terms[offset] = Multiply(output[(offset * subSize) + frequency], twiddles[offset * frequency * twiddleStep]);
+		}
+
+		switch (radix)
+		{
+			case 2:
+				output[frequency] = terms[0] + terms[1];
+				output[subSize + frequency] = terms[0] - terms[1];
+				break;
+
+			case 4:
+			{
+				// multiplying by -i (or i going back) is just a swap and a negate
+				const Sample even = terms[0] + terms[2];
+				const Sample evenDifference = terms[0] - terms[2];
+				const Sample odd = terms[1] + terms[3];
+				const Sample oddDifference = terms[1] - terms[3];
+				const Sample rotated = inverse ? Sample(-oddDifference.imag(), oddDifference.real()) : Sample(oddDifference.imag(), -oddDifference.real());
+
+				output[frequency] = even + odd;
+				output[subSize + frequency] = evenDifference + rotated;
+				output[(2 * subSize) + frequency] = even - odd;
+				output[(3 * subSize) + frequency] = evenDifference - rotated;
+				break;
+			}
+
+			default:
+			{
+				// the radix-th roots of unity are every (Size / radix)-th twiddle
+				const int rootStep = subSize * twiddleStep;
+				for (int block = 0; block < radix; ++block)
+				{
+					Sample sum = terms[0];
+					int root = 0;
+					for (int offset = 1; offset < radix; ++offset)
+					{
+						root += block;
+						if (root >= radix)
+							root -= radix;
+						sum += Multiply(terms[offset], twiddles[root * rootStep]);
+					}
+					output[(block * subSize) + frequency] = sum;
+				}
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+#include "Vector.h"
+#include "FieldStencil.h"
+
+class ThreadPool;
+
+/**
+ * Calculates the field of a whole grid with FFTs. The field of every emitter sharing a stencil is the stencil
+ * convolved with a mask of where those emitters are, and the x and y parts of the stencil are transformed together
+ * as the real and imaginary parts of one complex kernel. The masks are real, so they are transformed two at a time,
+ * and every product is summed in the frequency domain before a single inverse transform.
+ *
+ * The grid is zero padded to a size made of factors of 2, 3 and 5 that is big enough for the largest stencil not
+ * to wrap around. Spectra are stored as complex floats and each line is transformed in double precision. The
+ * kernel spectra are cached, keyed by the stencil's strength and range, until the padded size changes.
+ */
+class FieldConvolution
+{
+public:
+	~FieldConvolution() { InvalidateSpectra(); }
+
+	/**
+	 * Calculates the field of every cell. Cells are laid out as x * width + y, the same as the world.
+	 *
+	 * @param length The number of cells along x.
+	 * @param width The number of cells along y.
+	 * @param cellStencils The stencil of the emitter in each cell, or nullptr if the cell does not emit.
+	 * @param field Receives the field of every cell, including the ones that are obstructed.
+	 * @param pool The threads to run the transforms on.
+	 */
+	void Calculate(int length, int width, const std::vector<const FieldStencil*>& cellStencils, std::vector<Vector2f>& field, ThreadPool& pool);
+
+	/**
+	 * Throws away the cached kernel spectra.
+	 */
+	void InvalidateSpectra();
+
+	/**
+	 * Throws away the cached kernel spectra of one strength and range.
+	 *
+	 * @param fieldStrength The strength of the stencils the spectra were built from.
+	 * @param fieldRange The range of the stencils the spectra were built from.
+	 */
+	void InvalidateSpectra(float fieldStrength, float fieldRange);
+
+	/**
+	 * Gets the smallest size of at least minimum whose only prime factors are 2, 3 and 5.
+	 *
+	 * @param minimum The smallest acceptable size.
+	 *
+	 * @return The padded size.
+	 */
+	static int SmoothSize(int minimum);
+
+public:
+	/** The error against the scatter pass, per component and relative to the largest field magnitude (checked in Benchmark, where it stays below 1e-6). */
+	static const float Tolerance;
+
+protected:
+	typedef std::complex<float> Bin;
+	typedef std::complex<double> Sample;
+
+	struct Plan
+	{
+		int Size = 0;
+		std::vector<int> Factors;
+		std::vector<Sample> Twiddles;
+		std::vector<Sample> InverseTwiddles;
+
+		void Prepare(int size);
+	};
+
+	struct KernelSpectrum
+	{
+		float FieldStrength;
+		float FieldRange;
+		int Radius;
+		std::vector<Bin> Bins;
+	};
+
+	const std::vector<Bin>& GetSpectrum(const FieldStencil& stencil, ThreadPool& pool);
+	void Transform2D(std::vector<Bin>& grid, bool inverse, int rowCount, ThreadPool& pool);
+	void TransformLines(std::vector<Bin>& grid, const Plan& plan, int lineCount, int lineStep, int sampleStep, bool inverse, ThreadPool& pool);
+
+	static void Transform(const Plan& plan, const Sample* input, int inputStride, int size, Sample* output, int factorIndex, bool inverse);
+
+protected:
+	int paddedLength = 0;
+	int paddedWidth = 0;
+	Plan lengthPlan;
+	Plan widthPlan;
+
+	std::vector<KernelSpectrum*> spectra;
+	std::vector<Bin> maskSpectrum;
+	std::vector<Bin> fieldSpectrum;
+	std::vector<std::vector<Sample>> lineBuffers;
+};
@@ -0,0 +1,193 @@
+#include "FieldKernel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define FIELD_KERNEL_X86
+	#include <immintrin.h>
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+		#define FIELD_KERNEL_AVX2
+	#else
+		#define FIELD_KERNEL_AVX2 __attribute__((target("avx2")))
+	#endif
+#endif
+
+const float FieldKernel::Tolerance = 1e-5f;
+
+void EmitterArrays::Clear()
+{
+	X.clear();
+	Y.clear();
+	Strength.clear();
+	Range.clear();
+}
+
+void EmitterArrays::Add(const Tile& tile)
+{
+	X.push_back(tile.Location.X);
+	Y.push_back(tile.Location.Y);
+	Strength.push_back(tile.FieldStrength);
+	Range.push_back(tile.FieldRange);
+}
+
+static void AccumulateScalar(const EmitterArrays& emitters, int begin, int end, const Vector2f& receiver, Vector2f& field)
+{
+	for (int index = begin; index < end; ++index)
+	{
+		Vector2f vecToTile = receiver - Vector2f(emitters.X[index], emitters.Y[index]);
+
+		// skip the receiver itself
+		if (vecToTile.X == 0 && vecToTile.Y == 0)
+			continue;
+
+		if (emitters.Strength[index] == 0)
+			continue;
+
+		field += Tile::CalculateFieldAt(vecToTile, emitters.Strength[index], emitters.Range[index]);
+	}
+}
+
+#ifdef FIELD_KERNEL_X86
+static void AccumulateSSE(const EmitterArrays& emitters, int begin, int end, const Vector2f& receiver, Vector2f& field)
+{
+	const __m128 receiverX = _mm_set1_ps(receiver.X);
+	const __m128 receiverY = _mm_set1_ps(receiver.Y);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	__m128 fieldX = zero;
+	__m128 fieldY = zero;
+
+	int index = begin;
+	for (; index + 4 <= end; index += 4)
+	{
+		const __m128 vecX = _mm_sub_ps(receiverX, _mm_loadu_ps(&emitters.X[index]));
+		const __m128 vecY = _mm_sub_ps(receiverY, _mm_loadu_ps(&emitters.Y[index]));
+		const __m128 range = _mm_loadu_ps(&emitters.Range[index]);
+
+		const __m128 distSquared = _mm_add_ps(_mm_mul_ps(vecX, vecX), _mm_mul_ps(vecY, vecY));
+		const __m128 dist = _mm_sqrt_ps(distSquared);
+
+		// in range, and not the receiver itself
+		const __m128 mask = _mm_and_ps(_mm_cmpgt_ps(distSquared, zero), _mm_cmplt_ps(dist, range));
+
+		// strength * (1 - dist / range) / dist, which folds in the normalise
+		const __m128 falloff = _mm_sub_ps(one, _mm_div_ps(dist, range));
+		const __m128 scale = _mm_and_ps(mask, _mm_div_ps(_mm_mul_ps(_mm_loadu_ps(&emitters.Strength[index]), falloff), dist));
+
+		fieldX = _mm_add_ps(fieldX, _mm_mul_ps(vecX, scale));
+		fieldY = _mm_add_ps(fieldY, _mm_mul_ps(vecY, scale));
+	}
+
+	float laneX[4], laneY[4];
+	_mm_storeu_ps(laneX, fieldX);
+	_mm_storeu_ps(laneY, fieldY);
+	field += Vector2f((laneX[0] + laneX[1]) + (laneX[2] + laneX[3]), (laneY[0] + laneY[1]) + (laneY[2] + laneY[3]));
+
+	AccumulateScalar(emitters, index, end, receiver, field);
+}
+
+FIELD_KERNEL_AVX2
+static void AccumulateAVX2(const EmitterArrays& emitters, int begin, int end, const Vector2f& receiver, Vector2f& field)
+{
+	const __m256 receiverX = _mm256_set1_ps(receiver.X);
+	const __m256 receiverY = _mm256_set1_ps(receiver.Y);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+
+	__m256 fieldX = zero;
+	__m256 fieldY = zero;
+
+	int index = begin;
+	for (; index + 8 <= end; index += 8)
+	{
+		const __m256 vecX = _mm256_sub_ps(receiverX, _mm256_loadu_ps(&emitters.X[index]));
+		const __m256 vecY = _mm256_sub_ps(receiverY, _mm256_loadu_ps(&emitters.Y[index]));
+		const __m256 range = _mm256_loadu_ps(&emitters.Range[index]);
+
+		const __m256 distSquared = _mm256_add_ps(_mm256_mul_ps(vecX, vecX), _mm256_mul_ps(vecY, vecY));
+		const __m256 dist = _mm256_sqrt_ps(distSquared);
+
+		// in range, and not the receiver itself
+		const __m256 mask = _mm256_and_ps(_mm256_cmp_ps(distSquared, zero, _CMP_GT_OQ), _mm256_cmp_ps(dist, range, _CMP_LT_OQ));
+
+		// strength * (1 - dist / range) / dist, which folds in the normalise
+		const __m256 falloff = _mm256_sub_ps(one, _mm256_div_ps(dist, range));
+		const __m256 scale = _mm256_and_ps(mask, _mm256_div_ps(_mm256_mul_ps(_mm256_loadu_ps(&emitters.Strength[index]), falloff), dist));
+
+		fieldX = _mm256_add_ps(fieldX, _mm256_mul_ps(vecX, scale));
+		fieldY = _mm256_add_ps(fieldY, _mm256_mul_ps(vecY, scale));
+	}
+
+	float laneX[8], laneY[8];
+	_mm256_storeu_ps(laneX, fieldX);
+	_mm256_storeu_ps(laneY, fieldY);
+	field += Vector2f(((laneX[0] + laneX[1]) + (laneX[2] + laneX[3])) + ((laneX[4] + laneX[5]) + (laneX[6] + laneX[7])),
+					  ((laneY[0] + laneY[1]) + (laneY[2] + laneY[3])) + ((laneY[4] + laneY[5]) + (laneY[6] + laneY[7])));
+
+	// finish off with the 4 wide path, which hands the last few to the scalar path
+	AccumulateSSE(emitters, index, end, receiver, field);
+}
+#endif
+
+void FieldKernel::Accumulate(KernelIsa isa, const EmitterArrays& emitters, int begin, int end, const Vector2f& receiver, Vector2f& field)
+{
+#ifdef FIELD_KERNEL_X86
+	switch (isa)
+	{
+		case ekiAVX2:
+			AccumulateAVX2(emitters, begin, end, receiver, field);
+			return;
+
+		case ekiSSE:
+			AccumulateSSE(emitters, begin, end, receiver, field);
+			return;
+
+		default:
+			break;
+	}
+#endif
+
+	AccumulateScalar(emitters, begin, end, receiver, field);
+}
+
+KernelIsa FieldKernel::BestIsa()
+{
+#if defined(FIELD_KERNEL_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	const int highestLeaf = info[0];
+
+	__cpuid(info, 1);
+	const bool hasSSE = (info[3] & (1 << 25)) != 0;
+	const bool hasOSXSave = (info[2] & (1 << 27)) != 0;
+	const bool hasAVX = (info[2] & (1 << 28)) != 0;
+
+	// AVX registers are only usable if the OS saves them on a context switch
+	bool hasAVX2 = false;
+	if (highestLeaf >= 7 && hasOSXSave && hasAVX && ((_xgetbv(0) & 0x6) == 0x6))
+	{
+		__cpuidex(info, 7, 0);
+		hasAVX2 = (info[1] & (1 << 5)) != 0;
+	}
+
+	if (hasAVX2)
+		return ekiAVX2;
+	if (hasSSE)
+		return ekiSSE;
+#elif defined(FIELD_KERNEL_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return ekiAVX2;
+	if (__builtin_cpu_supports("sse"))
+		return ekiSSE;
+#endif
+
+	return ekiScalar;
+}
+
+KernelIsa FieldKernel::Resolve(KernelIsa requested)
+{
+	static const KernelIsa bestIsa = BestIsa();
+
+	return (requested <= bestIsa) ? requested : bestIsa;
+}
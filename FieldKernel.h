@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+#include "Tile.h"
+
+enum KernelIsa
+{
+    ekiScalar,
+    ekiSSE,
+    ekiAVX2
+};
+
+/**
+ * Field emitters laid out as a structure of arrays, so the kernel can load several at once.
+ */
+struct EmitterArrays
+{
+public:
+	/**
+	 * Removes every emitter, keeping the storage.
+	 */
+	void Clear();
+
+	/**
+	 * Appends an emitter.
+	 *
+	 * @param tile The emitting tile.
+	 */
+	void Add(const Tile& tile);
+
+	/**
+	 * Gets the number of emitters.
+	 *
+	 * @return The number of emitters.
+	 */
+	int Size() const { return static_cast<int>(X.size()); }
+
+public:
+	std::vector<float> X;
+	std::vector<float> Y;
+	std::vector<float> Strength;
+	std::vector<float> Range;
+};
+
+/**
+ * Batched version of Tile::CalculateFieldTo. The SSE and AVX2 paths process 4 and 8 emitters per iteration
+ * and are selected at runtime; the scalar path calls Tile::CalculateFieldAt and matches it exactly.
+ *
+ * The vector paths fold the normalise and falloff into a single scale and sum the lanes in a different order,
+ * so their result differs from the scalar path by rounding only. Each component stays within Tolerance of the
+ * scalar result, relative to the largest field magnitude in the world (checked in Benchmark, where it stays below 1e-6).
+ */
+class FieldKernel
+{
+public:
+	/**
+	 * Adds the field of a range of emitters at a receiver location to field. Emitters at the same location
+	 * as the receiver (i.e. the receiver itself) are skipped.
+	 *
+	 * @param isa The instruction set to use, it must be supported.
+	 * @param emitters The emitters.
+	 * @param begin The first emitter to include.
+	 * @param end One past the last emitter to include.
+	 * @param receiver The location of the receiver.
+	 * @param field The field to add to.
+	 */
+	static void Accumulate(KernelIsa isa, const EmitterArrays& emitters, int begin, int end, const Vector2f& receiver, Vector2f& field);
+
+	/**
+	 * Gets the best instruction set the CPU supports.
+	 *
+	 * @return The best supported instruction set.
+	 */
+	static KernelIsa BestIsa();
+
+	/**
+	 * Limits a requested instruction set to one the CPU supports.
+	 *
+	 * @param requested The instruction set to use if possible.
+	 *
+	 * @return The requested instruction set, or the best supported one if it is not available.
+	 */
+	static KernelIsa Resolve(KernelIsa requested);
+
+public:
+	static const float Tolerance;
+};
@@ -0,0 +1,38 @@
+#include "FieldStencil.h"
+#include "Tile.h"
+#include <algorithm>
+
+FieldStencil::FieldStencil(float _fieldStrength, float _fieldRange, int maxRadius) :
+	FieldStrength(_fieldStrength), FieldRange(_fieldRange)
+{
+	Radius = RadiusFor(_fieldRange, maxRadius);
+	Side = std::max((Radius * 2) + 1, 0);
+
+	values.resize(Side * Side);
+	for (int offsetX = -Radius; offsetX <= Radius; ++offsetX)
+	{
+		for (int offsetY = -Radius; offsetY <= Radius; ++offsetY)
+		{
+			// the emitter itself gets no contribution (the kernel is undefined at zero distance)
+			if (offsetX == 0 && offsetY == 0)
+				continue;
+
+			values[((offsetX + Radius) * Side) + (offsetY + Radius)] =
+				Tile::CalculateFieldAt(Vector2f((float)offsetX, (float)offsetY), FieldStrength, FieldRange);
+		}
+	}
+}
+
+bool FieldStencil::Matches(float fieldStrength, float fieldRange, int maxRadius) const
+{
+	return (FieldStrength == fieldStrength) && (FieldRange == fieldRange) && (Radius >= RadiusFor(fieldRange, maxRadius));
+}
+
+int FieldStencil::RadiusFor(float fieldRange, int maxRadius)
+{
+	// only offsets strictly closer than the range contribute
+	if (fieldRange <= 0)
+		return -1;
+
+	return std::min((int)std::ceil(fieldRange) - 1, maxRadius);
+}
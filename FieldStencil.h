@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include "Vector.h"
+
+/**
+ * Precomputed field contributions of an emitter with a given strength and range, for every integer offset
+ * that it can reach. On the tile grid this turns the field kernel into a table lookup.
+ */
+class FieldStencil
+{
+public:
+	/**
+	 * Builds the stencil.
+	 *
+	 * @param _fieldStrength The strength of the emitter.
+	 * @param _fieldRange The range of the emitter.
+	 * @param maxRadius The largest offset worth storing, usually the size of the world.
+	 */
+	FieldStencil(float _fieldStrength, float _fieldRange, int maxRadius);
+
+	/**
+	 * Tests if this stencil can be used for an emitter.
+	 *
+	 * @param fieldStrength The strength of the emitter.
+	 * @param fieldRange The range of the emitter.
+	 * @param maxRadius The largest offset that will be looked up.
+	 *
+	 * @return true if the stencil has the same strength and range and covers the offsets.
+	 */
+	bool Matches(float fieldStrength, float fieldRange, int maxRadius) const;
+
+	/**
+	 * Gets the contribution at an offset from the emitter. Both offsets must be within the radius.
+	 *
+	 * @param offsetX The x offset from the emitter to the receiver.
+	 * @param offsetY The y offset from the emitter to the receiver.
+	 *
+	 * @return The field contribution, matching Tile::CalculateFieldTo exactly.
+	 */
+	const Vector2f& At(int offsetX, int offsetY) const
+	{
+		return values[((offsetX + Radius) * Side) + (offsetY + Radius)];
+	}
+
+	/**
+	 * Gets the radius needed to cover every cell an emitter can reach.
+	 *
+	 * @param fieldRange The range of the emitter.
+	 * @param maxRadius The largest offset worth covering.
+	 *
+	 * @return The radius, or -1 if the emitter reaches nothing.
+	 */
+	static int RadiusFor(float fieldRange, int maxRadius);
+
+public:
+	float FieldStrength;
+	float FieldRange;
+	int Radius;
+	int Side;
+
+protected:
+	std::vector<Vector2f> values;
+};
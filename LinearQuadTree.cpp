@@ -0,0 +1,140 @@
+#include "LinearQuadTree.h"
+
+void LinearQuadTree::Build(const AABBf& bounds, const std::vector<Tile>& _tiles, const std::vector<int>& handles)
+{
+	tiles = &_tiles;
+	treeBounds = bounds;
+	cellSize = minNodeWidth;
+
+	// pick the depth at which a cell is no wider than the minimum node width
+	const float extent = std::max(bounds.Width(), bounds.Height());
+	depth = 0;
+	while (depth < MaxDepth && cellSize * (1 << depth) < extent)
+		++depth;
+	cellSize = std::max(cellSize, extent / (1 << depth));
+
+	// pass 1: compute the key of the cell each tile belongs to, packed above the tile's handle
+	std::vector<uint64_t> entries;
+	entries.reserve(handles.size());
+	for (int handle : handles)
+	{
+		const AABBf& tileBounds = _tiles[handle].bounds;
+
+		// tiles with an inverted (negative range) box can never be found
+		if (tileBounds.boxMax.X < tileBounds.boxMin.X || tileBounds.boxMax.Y < tileBounds.boxMin.Y)
+			continue;
+
+		uint32_t minX, minY, maxX, maxY;
+		CellCoordinates(tileBounds.boxMin, minX, minY);
+		CellCoordinates(tileBounds.boxMax, maxX, maxY);
+
+		// the deepest common level is where the corner coordinates stop differing
+		uint32_t difference = (minX ^ maxX) | (minY ^ maxY);
+		int shift = 0;
+		while (difference != 0)
+		{
+			difference >>= 1;
+			++shift;
+		}
+
+		const int level = depth - shift;
+		const uint32_t key = LevelOffset(level) + InterleaveBits(minX >> shift, minY >> shift);
+		entries.push_back((static_cast<uint64_t>(key) << 32) | static_cast<uint32_t>(handle));
+	}
+
+	// pass 2: sort by key, stable so tiles in the same cell stay in the order they were given
+	std::vector<uint64_t> scratch;
+	RadixSort(entries, scratch);
+
+	// pass 3: split into flat arrays and record where each level starts
+	sortedKeys.resize(entries.size());
+	sortedHandles.resize(entries.size());
+
+	int level = 0;
+	levelStart[0] = 0;
+	for (size_t entryIndex = 0; entryIndex < entries.size(); ++entryIndex)
+	{
+		const uint32_t key = static_cast<uint32_t>(entries[entryIndex] >> 32);
+		while (level <= depth && key >= LevelOffset(level + 1))
+			levelStart[++level] = static_cast<int>(entryIndex);
+
+		sortedKeys[entryIndex] = key;
+		sortedHandles[entryIndex] = static_cast<int>(static_cast<uint32_t>(entries[entryIndex]));
+	}
+	while (level <= depth)
+		levelStart[++level] = static_cast<int>(entries.size());
+}
+
+std::vector<int> LinearQuadTree::FindTiles(Vector2f target) const
+{
+	std::vector<int> result;
+
+	VisitTiles(target, [&result](int handle) { result.push_back(handle); });
+
+	return result;
+}
+
+void LinearQuadTree::CellCoordinates(const Vector2f& location, uint32_t& x, uint32_t& y) const
+{
+	const float maxCell = static_cast<float>((1 << depth) - 1);
+	const float cellX = std::floor((location.X - treeBounds.boxMin.X) / cellSize);
+	const float cellY = std::floor((location.Y - treeBounds.boxMin.Y) / cellSize);
+
+	// anything outside the tree is clamped to the edge cells
+	x = static_cast<uint32_t>(std::min(std::max(cellX, 0.0f), maxCell));
+	y = static_cast<uint32_t>(std::min(std::max(cellY, 0.0f), maxCell));
+}
+
+void LinearQuadTree::RadixSort(std::vector<uint64_t>& entries, std::vector<uint64_t>& scratch) const
+{
+	if (entries.empty())
+		return;
+
+	scratch.resize(entries.size());
+
+	// least significant digit first over the 32 key bits, 8 bits at a time
+	for (int pass = 0; pass < 4; ++pass)
+	{
+		const int shift = 32 + (pass * 8);
+
+		size_t counts[257] = {};
+		for (uint64_t entry : entries)
+			++counts[((entry >> shift) & 0xFF) + 1];
+
+		// every entry has the same digit, so this pass would not move anything
+		if (counts[((entries[0] >> shift) & 0xFF) + 1] == entries.size())
+			continue;
+
+		for (int digit = 0; digit < 256; ++digit)
+			counts[digit + 1] += counts[digit];
+
+		for (uint64_t entry : entries)
+			scratch[counts[(entry >> shift) & 0xFF]++] = entry;
+
+		entries.swap(scratch);
+	}
+}
+
+uint32_t LinearQuadTree::InterleaveBits(uint32_t x, uint32_t y)
+{
+	// spread the low 16 bits of each coordinate out to every other bit
+	x &= 0x0000FFFF;
+	x = (x | (x << 8)) & 0x00FF00FF;
+	x = (x | (x << 4)) & 0x0F0F0F0F;
+	x = (x | (x << 2)) & 0x33333333;
+	x = (x | (x << 1)) & 0x55555555;
+
+	y &= 0x0000FFFF;
+	y = (y | (y << 8)) & 0x00FF00FF;
+	y = (y | (y << 4)) & 0x0F0F0F0F;
+	y = (y | (y << 2)) & 0x33333333;
+	y = (y | (y << 1)) & 0x55555555;
+
+	return x | (y << 1);
+}
+
+uint32_t LinearQuadTree::LevelOffset(int level)
+{
+	// number of cells in all of the levels above this one: (4^level - 1) / 3
+	return static_cast<uint32_t>(((static_cast<uint64_t>(1) << (2 * level)) - 1) / 3);
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "Tile.h"
+
+/**
+ * Pointerless quadtree that is bulk loaded in a few linear passes. Each tile is filed under the smallest
+ * quadtree cell that fully contains its bounds, identified by a key made of the cell's level and Morton code.
+ * The keys are radix sorted, so the whole tree is two flat arrays and a table of where each level starts.
+ * Tiles are referred to by handle, their index in the tile array the tree was built over.
+ */
+class LinearQuadTree
+{
+public:
+	/**
+	 * Rebuilds the tree from scratch.
+	 *
+	 * @param bounds The area covered by the tree.
+	 * @param tiles The tiles that handles refer to. They must outlive the tree's use of them.
+	 * @param handles The handles of the tiles to add.
+	 */
+	void Build(const AABBf& bounds, const std::vector<Tile>& tiles, const std::vector<int>& handles);
+
+	/**
+	 * Finds every tile filed in a cell that contains the target location. This is a superset of the tiles
+	 * whose bounds contain the location, matching what QuadTree::FindTiles returns.
+	 *
+	 * @param target The location to search for.
+	 *
+	 * @return The handles of the tiles that could affect the target location.
+	 */
+	std::vector<int> FindTiles(Vector2f target) const;
+
+	/**
+	 * Calls the visitor for every tile that FindTiles would return, without allocating.
+	 *
+	 * @param target The location to search for.
+	 * @param visitor Callable taking a tile handle.
+	 */
+	template <typename Visitor>
+	void VisitTiles(const Vector2f& target, Visitor&& visitor) const;
+
+	/**
+	 * Calls the visitor with the [begin, end) spans of SortedHandles that VisitTiles would visit.
+	 *
+	 * @param target The location to search for.
+	 * @param visitor Callable taking two ints.
+	 */
+	template <typename Visitor>
+	void VisitRanges(const Vector2f& target, Visitor&& visitor) const;
+
+	/**
+	 * Calls the visitor exactly once for every tile whose bounds overlap the range. Does not allocate.
+	 *
+	 * @param range The area to search.
+	 * @param visitor Callable taking a tile handle.
+	 */
+	template <typename Visitor>
+	void QueryRange(const AABBf& range, Visitor&& visitor) const;
+
+	/**
+	 * Gets the number of tiles stored in the tree.
+	 *
+	 * @return The number of tiles.
+	 */
+	int Size() const { return static_cast<int>(sortedHandles.size()); }
+
+	/**
+	 * Gets the handles of the tiles in the order they are stored, grouped by level and then by cell.
+	 *
+	 * @return The sorted handles.
+	 */
+	const std::vector<int>& SortedHandles() const { return sortedHandles; }
+
+public:
+	float minNodeWidth = 1;
+
+	static const int MaxDepth = 15;
+
+protected:
+	template <typename Visitor>
+	void VisitCell(int level, uint32_t x, uint32_t y, Visitor& visitor) const;
+
+	template <typename Visitor>
+	void VisitCellRange(int level, uint32_t x, uint32_t y, Visitor& visitor) const;
+
+	void CellCoordinates(const Vector2f& location, uint32_t& x, uint32_t& y) const;
+	void RadixSort(std::vector<uint64_t>& entries, std::vector<uint64_t>& scratch) const;
+
+	static uint32_t InterleaveBits(uint32_t x, uint32_t y);
+	static uint32_t LevelOffset(int level);
+
+protected:
+	AABBf treeBounds;
+	float cellSize = 1;
+	int depth = 0;
+
+	const std::vector<Tile>* tiles = nullptr;
+	std::vector<uint32_t> sortedKeys;
+	std::vector<int> sortedHandles;
+	int levelStart[MaxDepth + 2] = {};
+};
+
+template <typename Visitor>
+void LinearQuadTree::VisitTiles(const Vector2f& target, Visitor&& visitor) const
+{
+	VisitRanges(target, [this, &visitor](int begin, int end)
+	{
+		for (int index = begin; index < end; ++index)
+		{
+			visitor(sortedHandles[index]);
+		}
+	});
+}
+
+template <typename Visitor>
+void LinearQuadTree::VisitRanges(const Vector2f& target, Visitor&& visitor) const
+{
+	if (sortedKeys.empty() || !treeBounds.Contains(target))
+		return;
+
+	uint32_t x, y;
+	CellCoordinates(target, x, y);
+
+	for (int level = 0; level <= depth; ++level)
+	{
+		const int shift = depth - level;
+		VisitCellRange(level, x >> shift, y >> shift, visitor);
+	}
+}
+
+template <typename Visitor>
+void LinearQuadTree::QueryRange(const AABBf& range, Visitor&& visitor) const
+{
+	if (sortedKeys.empty() || !treeBounds.Intersects(range))
+		return;
+
+	uint32_t minX, minY, maxX, maxY;
+	CellCoordinates(range.boxMin, minX, minY);
+	CellCoordinates(range.boxMax, maxX, maxY);
+
+	// every tile lives in exactly one cell, so there are no duplicates to filter out
+	auto visitOverlapping = [this, &range, &visitor](int handle)
+	{
+		if ((*tiles)[handle].bounds.Intersects(range))
+			visitor(handle);
+	};
+
+	for (int level = 0; level <= depth; ++level)
+	{
+		const int shift = depth - level;
+		for (uint32_t cellY = minY >> shift; cellY <= (maxY >> shift); ++cellY)
+		{
+			for (uint32_t cellX = minX >> shift; cellX <= (maxX >> shift); ++cellX)
+			{
+				VisitCell(level, cellX, cellY, visitOverlapping);
+			}
+		}
+	}
+}
+
+template <typename Visitor>
+void LinearQuadTree::VisitCell(int level, uint32_t x, uint32_t y, Visitor& visitor) const
+{
+	auto visitRange = [this, &visitor](int begin, int end)
+	{
+		for (int index = begin; index < end; ++index)
+		{
+			visitor(sortedHandles[index]);
+		}
+	};
+
+	VisitCellRange(level, x, y, visitRange);
+}
+
+template <typename Visitor>
+void LinearQuadTree::VisitCellRange(int level, uint32_t x, uint32_t y, Visitor& visitor) const
+{
+	// skip levels with nothing filed in them
+	if (levelStart[level] == levelStart[level + 1])
+		return;
+
+	const uint32_t key = LevelOffset(level) + InterleaveBits(x, y);
+
+	auto levelBegin = sortedKeys.begin() + levelStart[level];
+	auto levelEnd = sortedKeys.begin() + levelStart[level + 1];
+	auto range = std::equal_range(levelBegin, levelEnd, key);
+
+	if (range.first != range.second)
+		visitor(static_cast<int>(range.first - sortedKeys.begin()), static_cast<int>(range.second - sortedKeys.begin()));
+}
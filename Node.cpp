@@ -17,6 +17,10 @@ Node::Node(Vector2f _min, Vector2f _max, Node* _parent, int _depth)
 
 Node::~Node()
 {
+	for (auto child : children)
+	{
+		delete child;
+	}
 }
 
 void Node::AddObject(Tile* _tile)
@@ -0,0 +1,255 @@
+#include "Profiler.h"
+
+#if PROFILER_ENABLED
+
+#include "imgui.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+thread_local int ProfileScope::currentZone = -1;
+
+namespace
+{
+	/**
+	 * Hands a thread's ring back to the profiler when the thread exits, so the next thread can reuse it.
+	 */
+	struct ThreadRingOwner
+	{
+		ProfileRing* Ring = nullptr;
+
+		~ThreadRingOwner()
+		{
+			if (Ring)
+				Profiler::Instance().ReleaseRing(Ring);
+		}
+	};
+
+	thread_local ThreadRingOwner threadRing;
+
+	float Percentile(const std::vector<float>& sorted, float fraction)
+	{
+		const int index = (int)std::ceil(fraction * sorted.size()) - 1;
+		return sorted[std::min(std::max(index, 0), (int)sorted.size() - 1)];
+	}
+}
+
+Profiler& Profiler::Instance()
+{
+	// never destroyed, scopes on other threads may still be recording while statics are torn down
+	static Profiler* instance = new Profiler();
+	return *instance;
+}
+
+int Profiler::RegisterZone(const char* name)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	Zone zone;
+	zone.Name = name;
+	zone.History.assign(HistorySize, 0.0f);
+	zone.HistoryThreads.assign(HistorySize, 0);
+	zones.push_back(zone);
+
+	return (int)zones.size() - 1;
+}
+
+void Profiler::Record(const ProfileEvent& event)
+{
+	// only the first event on a thread takes the lock
+	if (!threadRing.Ring)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!freeRings.empty())
+		{
+			threadRing.Ring = freeRings.back();
+			freeRings.pop_back();
+		}
+		else
+		{
+			threadRing.Ring = new ProfileRing((int)rings.size());
+			rings.push_back(threadRing.Ring);
+		}
+	}
+
+	threadRing.Ring->Push(event);
+}
+
+void Profiler::Collect()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (ProfileRing* ring : rings)
+	{
+		ring->Drain([this, ring](const ProfileEvent& event)
+		{
+			// a zone entered outside any other (on a worker thread, say) moves under the first zone it is seen inside
+			Zone& zone = zones[event.Zone];
+			if (!zone.ParentSeen || (zone.Parent < 0 && event.Parent >= 0))
+			{
+				zone.Parent = event.Parent;
+				zone.ParentSeen = true;
+			}
+
+			AddSample(zone, event.Duration / 1000.0f, ring->GetThread());
+		});
+	}
+}
+
+void Profiler::AddSample(Zone& zone, float duration, int thread)
+{
+	zone.History[zone.NextSample] = duration;
+	zone.HistoryThreads[zone.NextSample] = thread;
+	zone.NextSample = (zone.NextSample + 1) % HistorySize;
+	zone.Samples = std::min(zone.Samples + 1, HistorySize);
+}
+
+ProfileSummary Profiler::Summarise(int zoneIndex) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	ProfileSummary summary;
+	const Zone& zone = zones[zoneIndex];
+	if (zone.Samples == 0)
+		return summary;
+
+	std::vector<float> sorted(zone.History.begin(), zone.History.begin() + zone.Samples);
+	std::sort(sorted.begin(), sorted.end());
+
+	std::vector<int> threads(zone.HistoryThreads.begin(), zone.HistoryThreads.begin() + zone.Samples);
+	std::sort(threads.begin(), threads.end());
+
+	summary.Samples = zone.Samples;
+	summary.Threads = (int)(std::unique(threads.begin(), threads.end()) - threads.begin());
+	summary.Min = sorted.front();
+	for (float duration : sorted)
+	{
+		summary.Average += duration;
+	}
+	summary.Average /= zone.Samples;
+	summary.P95 = Percentile(sorted, 0.95f);
+	summary.P99 = Percentile(sorted, 0.99f);
+
+	return summary;
+}
+
+int Profiler::FindZone(const char* name) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (int zoneIndex = 0; zoneIndex < (int)zones.size(); ++zoneIndex)
+	{
+		if (strcmp(zones[zoneIndex].Name, name) == 0)
+			return zoneIndex;
+	}
+
+	return -1;
+}
+
+void Profiler::ReleaseRing(ProfileRing* ring)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	freeRings.push_back(ring);
+}
+
+unsigned Profiler::GetDroppedCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	unsigned dropped = 0;
+	for (const ProfileRing* ring : rings)
+	{
+		dropped += ring->GetDroppedCount();
+	}
+
+	return dropped;
+}
+
+void Profiler::OrderZones(int parent, int depth, std::vector<int>& order, std::vector<int>& depths) const
+{
+	for (int zoneIndex = 0; zoneIndex < (int)zones.size(); ++zoneIndex)
+	{
+		// zones that haven't been entered yet have nothing to show
+		const Zone& zone = zones[zoneIndex];
+		if (!zone.ParentSeen || zone.Parent != parent || std::find(order.begin(), order.end(), zoneIndex) != order.end())
+			continue;
+
+		order.push_back(zoneIndex);
+		depths.push_back(depth);
+		OrderZones(zoneIndex, depth + 1, order, depths);
+	}
+}
+
+void Profiler::DrawPanel(bool* open)
+{
+	Collect();
+
+	// depth first from the zones that were entered outside any other
+	std::vector<int> order;
+	std::vector<int> depths;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		OrderZones(-1, 0, order, depths);
+	}
+
+	ImGui::SetNextWindowSize(ImVec2(560, 360), ImGuiSetCond_FirstUseEver);
+	if (!ImGui::Begin("Profiler", open))
+	{
+		ImGui::End();
+		return;
+	}
+
+	ImGui::Text("Last %d passes per zone, in microseconds. Dropped events: %u", HistorySize, GetDroppedCount());
+
+	ImGui::Columns(7, "ProfilerZones");
+	ImGui::Text("Zone"); ImGui::NextColumn();
+	ImGui::Text("Threads"); ImGui::NextColumn();
+	ImGui::Text("Min"); ImGui::NextColumn();
+	ImGui::Text("Avg"); ImGui::NextColumn();
+	ImGui::Text("p95"); ImGui::NextColumn();
+	ImGui::Text("p99"); ImGui::NextColumn();
+	ImGui::Text("Samples"); ImGui::NextColumn();
+	ImGui::Separator();
+
+	for (int row = 0; row < (int)order.size(); ++row)
+	{
+		const int zoneIndex = order[row];
+		const ProfileSummary summary = Summarise(zoneIndex);
+
+		// Indent(0) would indent by the default spacing
+		const float indent = depths[row] * ImGui::GetStyle().IndentSpacing;
+		ImGui::PushID(zoneIndex);
+		if (indent > 0)
+			ImGui::Indent(indent);
+		if (ImGui::Selectable(zones[zoneIndex].Name, selectedZone == zoneIndex, ImGuiSelectableFlags_SpanAllColumns))
+			selectedZone = zoneIndex;
+		if (indent > 0)
+			ImGui::Unindent(indent);
+		ImGui::PopID();
+		ImGui::NextColumn();
+
+		ImGui::Text("%d", summary.Threads); ImGui::NextColumn();
+		ImGui::Text("%.1f", summary.Min); ImGui::NextColumn();
+		ImGui::Text("%.1f", summary.Average); ImGui::NextColumn();
+		ImGui::Text("%.1f", summary.P95); ImGui::NextColumn();
+		ImGui::Text("%.1f", summary.P99); ImGui::NextColumn();
+		ImGui::Text("%d", summary.Samples); ImGui::NextColumn();
+	}
+	ImGui::Columns(1);
+
+	// the selected zone's history, oldest first
+	if (selectedZone >= 0)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const Zone& zone = zones[selectedZone];
+		const int offset = (zone.Samples == HistorySize) ? zone.NextSample : 0;
+
+		ImGui::Separator();
+		ImGui::PlotHistogram("##History", zone.History.data(), zone.Samples, offset, zone.Name, 0.0f, FLT_MAX, ImVec2(ImGui::GetContentRegionAvailWidth(), 80));
+	}
+
+	ImGui::End();
+}
+
+#endif
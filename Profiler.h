@@ -0,0 +1,231 @@
+#pragma once
+
+// Define PROFILER_ENABLED as 0 to compile every PROFILE_SCOPE, and the profiler itself, out.
+#ifndef PROFILER_ENABLED
+	#define PROFILER_ENABLED 1
+#endif
+
+#if PROFILER_ENABLED
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/**
+ * One timed pass through a scope: which zone it was, the zone of the scope it was nested in, and how long it took.
+ */
+struct ProfileEvent
+{
+	int Zone;
+	int Parent;
+	int64_t Duration;
+};
+
+/**
+ * Fixed size ring of events with a single producer, the thread the ring belongs to, and a single consumer, the
+ * profiler collecting them. Neither side ever waits: a full ring drops the event and counts it instead.
+ */
+class ProfileRing
+{
+public:
+	explicit ProfileRing(int _thread) : thread(_thread) {}
+
+	/**
+	 * Adds an event. Only the thread the ring belongs to may call this.
+	 *
+	 * @param event The event to add.
+	 */
+	void Push(const ProfileEvent& event)
+	{
+		const uint32_t writeIndex = head.load(std::memory_order_relaxed);
+		if (writeIndex - tail.load(std::memory_order_acquire) >= Capacity)
+		{
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		events[writeIndex % Capacity] = event;
+		head.store(writeIndex + 1, std::memory_order_release);
+	}
+
+	/**
+	 * Takes every event added so far. Only the profiler may call this.
+	 *
+	 * @param visitor Callable taking a const ProfileEvent&.
+	 */
+	template <typename Visitor>
+	void Drain(Visitor&& visitor)
+	{
+		const uint32_t readEnd = head.load(std::memory_order_acquire);
+		uint32_t readIndex = tail.load(std::memory_order_relaxed);
+		for (; readIndex != readEnd; ++readIndex)
+		{
+			visitor(events[readIndex % Capacity]);
+		}
+		tail.store(readIndex, std::memory_order_release);
+	}
+
+	int GetThread() const { return thread; }
+	unsigned GetDroppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+public:
+	static const uint32_t Capacity = 4096;
+
+protected:
+	int thread;
+	ProfileEvent events[Capacity];
+	std::atomic<uint32_t> head{ 0 };
+	std::atomic<uint32_t> tail{ 0 };
+	std::atomic<unsigned> dropped{ 0 };
+};
+
+/**
+ * The recent timings of a zone, over the last HistorySize passes through it on any thread.
+ */
+struct ProfileSummary
+{
+	int Samples = 0;
+	int Threads = 0;
+	float Min = 0;
+	float Average = 0;
+	float P95 = 0;
+	float P99 = 0;
+};
+
+/**
+ * Collects the events of every ProfileScope, on every thread, into a rolling history per zone. Recording an event
+ * only touches the recording thread's own ring; the rings are drained by Collect, once a frame. Zones are nested
+ * under the zone they were first seen inside.
+ */
+class Profiler
+{
+public:
+	static Profiler& Instance();
+
+	/**
+	 * Registers a named zone. PROFILE_SCOPE does this once per call site.
+	 *
+	 * @param name The zone's name, which must outlive the profiler (a string literal).
+	 *
+	 * @return The zone's index.
+	 */
+	int RegisterZone(const char* name);
+
+	/**
+	 * Records an event from the calling thread, registering the thread's ring the first time.
+	 *
+	 * @param event The event.
+	 */
+	void Record(const ProfileEvent& event);
+
+	/**
+	 * Moves the events recorded since the last call into the zones' histories.
+	 */
+	void Collect();
+
+	/**
+	 * Gets the summary of a zone's history. Durations are in microseconds.
+	 *
+	 * @param zone The zone's index.
+	 */
+	ProfileSummary Summarise(int zone) const;
+
+	/**
+	 * Finds a zone by name.
+	 *
+	 * @return The zone's index, or -1 if no scope with that name has been entered yet.
+	 */
+	int FindZone(const char* name) const;
+
+	/**
+	 * Collects the latest events and draws a window listing every zone, indented under its parent, with its
+	 * recent min, average, 95th and 99th percentile times, and a histogram of the selected zone's history.
+	 *
+	 * @param open Cleared when the window is closed, if given.
+	 */
+	void DrawPanel(bool* open = nullptr);
+
+	/**
+	 * Takes back the ring of a thread that is exiting, for the next new thread to use. Events left in it are
+	 * still collected.
+	 *
+	 * @param ring The exiting thread's ring.
+	 */
+	void ReleaseRing(ProfileRing* ring);
+
+	unsigned GetDroppedCount() const;
+
+public:
+	/** Each zone keeps this many of its most recent durations. */
+	static const int HistorySize = 256;
+
+protected:
+	struct Zone
+	{
+		const char* Name;
+		int Parent = -1;
+		bool ParentSeen = false;
+		std::vector<float> History;
+		std::vector<int> HistoryThreads;
+		int NextSample = 0;
+		int Samples = 0;
+	};
+
+	Profiler() = default;
+	void AddSample(Zone& zone, float duration, int thread);
+	void OrderZones(int zone, int depth, std::vector<int>& order, std::vector<int>& depths) const;
+
+protected:
+	// registration and collection take the mutex, recording never does
+	mutable std::mutex mutex;
+	std::vector<Zone> zones;
+	std::vector<ProfileRing*> rings;
+	std::vector<ProfileRing*> freeRings;
+	int selectedZone = -1;
+};
+
+/**
+ * Times the rest of the enclosing scope as a pass through a zone, nested inside whichever scope the thread is in.
+ */
+class ProfileScope
+{
+public:
+	explicit ProfileScope(int _zone) :
+		zone(_zone), parent(currentZone), start(std::chrono::steady_clock::now())
+	{
+		currentZone = zone;
+	}
+
+	~ProfileScope()
+	{
+		const int64_t duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		currentZone = parent;
+		Profiler::Instance().Record({ zone, parent, duration });
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+protected:
+	int zone;
+	int parent;
+	std::chrono::steady_clock::time_point start;
+
+	static thread_local int currentZone;
+};
+
+#define PROFILE_JOIN_INNER(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN_INNER(a, b)
+
+/** Times the rest of the enclosing scope under the given name (a string literal). */
+#define PROFILE_SCOPE(name) \
+	static const int PROFILE_JOIN(profileZone, __LINE__) = Profiler::Instance().RegisterZone(name); \
+	ProfileScope PROFILE_JOIN(profileScope, __LINE__)(PROFILE_JOIN(profileZone, __LINE__))
+
+#else
+
+#define PROFILE_SCOPE(name)
+
+#endif
@@ -0,0 +1,381 @@
+#include "QuadTree.h"
+#include <future>
+#include <thread>
+
+void QuadTree::Reset(const AABBf& bounds, std::vector<Tile>& _tiles)
+{
+	tiles = &_tiles;
+
+	if (nodes.empty())
+		nodes.resize(1);
+
+	// nodes past nodeCount are stale and get re-initialised when they are handed out again
+	nodeCount = 1;
+	freeBlocks.clear();
+
+	QuadNode& root = nodes[0];
+	root.boundingBox = bounds;
+	root.parent = -1;
+	root.firstChild = -1;
+	root.depth = 0;
+	root.contents.clear();
+}
+
+void QuadTree::Build(const AABBf& bounds, std::vector<Tile>& _tiles, const std::vector<int>& handles)
+{
+	Reset(bounds, _tiles);
+
+	for (int handle : handles)
+	{
+		AddObject(0, handle);
+	}
+}
+
+void QuadTree::BuildParallel(const AABBf& bounds, std::vector<Tile>& _tiles, const std::vector<int>& handles, unsigned threadCount)
+{
+	Reset(bounds, _tiles);
+
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<int> rootHandles(handles);
+	BuildSubtree(0, rootHandles, threadCount);
+}
+
+void QuadTree::AddObject(int handle)
+{
+	if (nodeCount == 0)
+		return;
+
+	AddObject(0, handle);
+}
+
+bool QuadTree::RemoveObject(int handle, const AABBf& oldBounds)
+{
+	if (nodeCount == 0)
+		return false;
+
+	return RemoveObject(0, handle, oldBounds);
+}
+
+bool QuadTree::RemoveObject(int handle)
+{
+	return RemoveObject(handle, (*tiles)[handle].bounds);
+}
+
+void QuadTree::UpdateObject(int handle, const AABBf& oldBounds)
+{
+	RemoveObject(handle, oldBounds);
+	AddObject(handle);
+}
+
+void QuadTree::MoveObject(int handle, const Vector2f& newLocation)
+{
+	Tile& tile = (*tiles)[handle];
+	const AABBf oldBounds = tile.bounds;
+
+	tile.Location = newLocation;
+	tile.UpdateBounds();
+
+	UpdateObject(handle, oldBounds);
+}
+
+const std::vector<int>& QuadTree::FindTiles(const Vector2f& target) const
+{
+	static const std::vector<int> NoTiles;
+
+	const int leafIndex = FindLeaf(target);
+	if (leafIndex < 0)
+		return NoTiles;
+
+	return nodes[leafIndex].contents;
+}
+
+int QuadTree::FindLeaf(const Vector2f& target) const
+{
+	if (nodeCount == 0)
+		return -1;
+
+	int nodeIndex = 0;
+	while (!nodes[nodeIndex].IsLeaf())
+	{
+		const int firstChild = nodes[nodeIndex].firstChild;
+
+		int nextIndex = -1;
+		for (int childIndex = firstChild; childIndex < firstChild + 4; ++childIndex)
+		{
+			if (nodes[childIndex].boundingBox.Contains(target))
+			{
+				nextIndex = childIndex;
+				break;
+			}
+		}
+
+		// outside of every child, so there is nothing more specific to return
+		if (nextIndex < 0)
+			break;
+
+		nodeIndex = nextIndex;
+	}
+
+	return nodeIndex;
+}
+
+void QuadTree::AddObject(int nodeIndex, int handle)
+{
+	// NOTE: the pool may grow while adding, so nodes are re-fetched by index rather than held by reference
+	if (!nodes[nodeIndex].IsLeaf())
+	{
+		const AABBf& tileBounds = (*tiles)[handle].bounds;
+		const int firstChild = nodes[nodeIndex].firstChild;
+		for (int childIndex = firstChild; childIndex < firstChild + 4; ++childIndex)
+		{
+			if (tileBounds.Intersects(nodes[childIndex].boundingBox))
+			{
+				AddObject(childIndex, handle);
+			}
+		}
+		return;
+	}
+
+	nodes[nodeIndex].contents.push_back(handle);
+
+	if (nodes[nodeIndex].boundingBox.Width() > minNodeWidth && nodes[nodeIndex].contents.size() > objectsPerNode)
+	{
+		Split(nodeIndex);
+	}
+}
+
+bool QuadTree::RemoveObject(int nodeIndex, int handle, const AABBf& oldBounds)
+{
+	QuadNode& node = nodes[nodeIndex];
+
+	if (node.IsLeaf())
+	{
+		auto tileIt = std::find(node.contents.begin(), node.contents.end(), handle);
+		if (tileIt == node.contents.end())
+			return false;
+
+		// erase rather than swap so the remaining tiles keep the order they were added in
+		node.contents.erase(tileIt);
+		return true;
+	}
+
+	bool removed = false;
+	for (int childIndex = node.firstChild; childIndex < node.firstChild + 4; ++childIndex)
+	{
+		if (oldBounds.Intersects(nodes[childIndex].boundingBox))
+		{
+			removed |= RemoveObject(childIndex, handle, oldBounds);
+		}
+	}
+
+	if (removed)
+		TryCollapse(nodeIndex);
+
+	return removed;
+}
+
+void QuadTree::Split(int nodeIndex)
+{
+	const int firstChild = AllocateChildren(nodeIndex);
+	SetChildBounds(nodeIndex, firstChild);
+
+	// take the contents out so they can be redistributed, then hand the (now empty) storage back
+	std::vector<int> redistribute;
+	redistribute.swap(nodes[nodeIndex].contents);
+	nodes[nodeIndex].firstChild = firstChild;
+
+	for (int handle : redistribute)
+	{
+		const AABBf& tileBounds = (*tiles)[handle].bounds;
+		for (int childIndex = firstChild; childIndex < firstChild + 4; ++childIndex)
+		{
+			if (nodes[childIndex].boundingBox.Intersects(tileBounds))
+			{
+				AddObject(childIndex, handle);
+			}
+		}
+	}
+
+	redistribute.clear();
+	nodes[nodeIndex].contents.swap(redistribute);
+}
+
+void QuadTree::SetChildBounds(int nodeIndex, int firstChild)
+{
+	const AABBf box = nodes[nodeIndex].boundingBox;
+	const Vector2f centre = box.Centre();
+
+	// same quadrant order as Node: bottom left, bottom right, top right, top left
+	nodes[firstChild + 0].boundingBox = AABBf(box.boxMin, centre);
+	nodes[firstChild + 1].boundingBox = AABBf(Vector2f(centre.X, box.boxMin.Y), Vector2f(box.boxMax.X, centre.Y));
+	nodes[firstChild + 2].boundingBox = AABBf(centre, box.boxMax);
+	nodes[firstChild + 3].boundingBox = AABBf(Vector2f(box.boxMin.X, centre.Y), Vector2f(centre.X, box.boxMax.Y));
+}
+
+void QuadTree::BuildSubtree(int nodeIndex, std::vector<int>& handles, unsigned taskBudget)
+{
+	// adding the tiles one at a time only ever splits a node once it holds too many of them, so a node
+	// that would not split just keeps all of its tiles in their original order
+	if (handles.size() <= objectsPerNode || nodes[nodeIndex].boundingBox.Width() <= minNodeWidth)
+	{
+		nodes[nodeIndex].contents.assign(handles.begin(), handles.end());
+		return;
+	}
+
+	const int firstChild = AllocateChildren(nodeIndex);
+	SetChildBounds(nodeIndex, firstChild);
+	nodes[nodeIndex].firstChild = firstChild;
+
+	// partition the tiles by quadrant, keeping their order
+	std::vector<int> childTiles[4];
+	for (int handle : handles)
+	{
+		const AABBf& tileBounds = (*tiles)[handle].bounds;
+		for (int quadrant = 0; quadrant < 4; ++quadrant)
+		{
+			if (nodes[firstChild + quadrant].boundingBox.Intersects(tileBounds))
+				childTiles[quadrant].push_back(handle);
+		}
+	}
+	std::vector<int>().swap(handles);
+
+	if (taskBudget <= 1 || childTiles[0].size() + childTiles[1].size() + childTiles[2].size() + childTiles[3].size() < ParallelBuildCutoff)
+	{
+		for (int quadrant = 0; quadrant < 4; ++quadrant)
+		{
+			BuildSubtree(firstChild + quadrant, childTiles[quadrant], 1);
+		}
+		return;
+	}
+
+	// each quadrant is built into a tree of its own, three as tasks and one on this thread
+	QuadTree subtrees[4];
+	const unsigned childBudget = (taskBudget + 3) / 4;
+	for (int quadrant = 0; quadrant < 4; ++quadrant)
+	{
+		subtrees[quadrant].minNodeWidth = minNodeWidth;
+		subtrees[quadrant].objectsPerNode = objectsPerNode;
+		subtrees[quadrant].Reset(nodes[firstChild + quadrant].boundingBox, *tiles);
+		subtrees[quadrant].nodes[0].depth = nodes[firstChild + quadrant].depth;
+	}
+
+	std::future<void> tasks[3];
+	for (int quadrant = 1; quadrant < 4; ++quadrant)
+	{
+		QuadTree* subtree = &subtrees[quadrant];
+		std::vector<int>* quadrantTiles = &childTiles[quadrant];
+		tasks[quadrant - 1] = std::async(std::launch::async, [subtree, quadrantTiles, childBudget]()
+		{
+			subtree->BuildSubtree(0, *quadrantTiles, childBudget);
+		});
+	}
+	subtrees[0].BuildSubtree(0, childTiles[0], childBudget);
+
+	for (std::future<void>& task : tasks)
+	{
+		task.get();
+	}
+
+	// splicing in child order keeps the node layout independent of how the tasks were scheduled
+	for (int quadrant = 0; quadrant < 4; ++quadrant)
+	{
+		SpliceSubtree(subtrees[quadrant], firstChild + quadrant);
+	}
+}
+
+void QuadTree::SpliceSubtree(QuadTree& subtree, int nodeIndex)
+{
+	// the subtree's root replaces nodeIndex, everything else is appended to the end of the pool
+	const int base = nodeCount - 1;
+	auto remap = [nodeIndex, base](int subtreeIndex)
+	{
+		return subtreeIndex == 0 ? nodeIndex : base + subtreeIndex;
+	};
+
+	nodeCount += subtree.nodeCount - 1;
+	if (static_cast<int>(nodes.size()) < nodeCount)
+		nodes.resize(nodeCount);
+
+	for (int subtreeIndex = 0; subtreeIndex < subtree.nodeCount; ++subtreeIndex)
+	{
+		QuadNode& source = subtree.nodes[subtreeIndex];
+		QuadNode& target = nodes[remap(subtreeIndex)];
+
+		target.boundingBox = source.boundingBox;
+		target.depth = source.depth;
+		target.firstChild = source.IsLeaf() ? -1 : remap(source.firstChild);
+		if (subtreeIndex != 0)
+			target.parent = remap(source.parent);
+		target.contents.swap(source.contents);
+	}
+}
+
+void QuadTree::TryCollapse(int nodeIndex)
+{
+	const int firstChild = nodes[nodeIndex].firstChild;
+
+	// only merge a block of leaves, deeper subtrees collapse first on their own
+	for (int childIndex = firstChild; childIndex < firstChild + 4; ++childIndex)
+	{
+		if (!nodes[childIndex].IsLeaf())
+			return;
+	}
+
+	// gather the distinct tiles straight into the parent's (empty) contents, giving up once it is too full
+	std::vector<int>& merged = nodes[nodeIndex].contents;
+	for (int childIndex = firstChild; childIndex < firstChild + 4; ++childIndex)
+	{
+		for (int handle : nodes[childIndex].contents)
+		{
+			if (std::find(merged.begin(), merged.end(), handle) != merged.end())
+				continue;
+
+			merged.push_back(handle);
+			if (merged.size() > objectsPerNode)
+			{
+				merged.clear();
+				return;
+			}
+		}
+	}
+
+	// the parent becomes a leaf again and the block of children can be reused
+	for (int childIndex = firstChild; childIndex < firstChild + 4; ++childIndex)
+	{
+		nodes[childIndex].contents.clear();
+	}
+	nodes[nodeIndex].firstChild = -1;
+	freeBlocks.push_back(firstChild);
+}
+
+int QuadTree::AllocateChildren(int parentIndex)
+{
+	int firstChild;
+	if (!freeBlocks.empty())
+	{
+		firstChild = freeBlocks.back();
+		freeBlocks.pop_back();
+	}
+	else
+	{
+		firstChild = nodeCount;
+		nodeCount += 4;
+
+		if (static_cast<int>(nodes.size()) < nodeCount)
+			nodes.resize(nodeCount);
+	}
+
+	const unsigned childDepth = nodes[parentIndex].depth + 1;
+	for (int childIndex = firstChild; childIndex < firstChild + 4; ++childIndex)
+	{
+		QuadNode& child = nodes[childIndex];
+		child.parent = parentIndex;
+		child.firstChild = -1;
+		child.depth = childDepth;
+		child.contents.clear();
+	}
+
+	return firstChild;
+}
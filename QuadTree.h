@@ -0,0 +1,315 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "Tile.h"
+
+/**
+ * A single node of a QuadTree. Nodes live in the tree's node pool and refer to each other by index.
+ * The four children of a node are always allocated as one contiguous block, so only the index of the
+ * first child is stored.
+ */
+struct QuadNode
+{
+public:
+	/**
+	 * Query if this node has no children.
+	 *
+	 * @return true if the node is a leaf.
+	 */
+	bool IsLeaf() const { return firstChild < 0; }
+
+public:
+	AABBf boundingBox;
+	int parent = -1;
+	int firstChild = -1;
+	unsigned depth = 0;
+	std::vector<int> contents;
+};
+
+/**
+ * Quadtree that owns all of its nodes in a single contiguous pool. Rebuilding the tree reuses the pool
+ * (and the storage of each node's contents) instead of allocating a fresh node per split. Tiles are referred to
+ * by handle, their index in the tile array the tree was built over.
+ */
+class QuadTree
+{
+public:
+	/**
+	 * Empties the tree in O(1) and sets up a new root node covering the given bounds. The node pool is
+	 * kept, so subsequent builds of a similar size do not touch the allocator.
+	 *
+	 * @param bounds The bounds of the root node.
+	 * @param tiles The tiles that handles refer to. They must outlive the tree's use of them.
+	 */
+	void Reset(const AABBf& bounds, std::vector<Tile>& tiles);
+
+	/**
+	 * Resets the tree and adds every tile to it, in order.
+	 *
+	 * @param bounds The bounds of the root node.
+	 * @param tiles The tiles that handles refer to.
+	 * @param handles The handles of the tiles to add.
+	 */
+	void Build(const AABBf& bounds, std::vector<Tile>& tiles, const std::vector<int>& handles);
+
+	/**
+	 * Builds the same tree as Build, but top down: the tiles are partitioned by quadrant and large
+	 * subtrees are built as concurrent tasks, then spliced into the pool in child order.
+	 *
+	 * @param bounds The bounds of the root node.
+	 * @param tiles The tiles that handles refer to.
+	 * @param handles The handles of the tiles to add.
+	 * @param threadCount The number of threads to use, 0 to use every hardware thread.
+	 */
+	void BuildParallel(const AABBf& bounds, std::vector<Tile>& tiles, const std::vector<int>& handles, unsigned threadCount = 0);
+
+	/**
+	 * Adds a tile to every leaf its bounds intersect, splitting leaves that become too full.
+	 *
+	 * @param handle The tile to add.
+	 */
+	void AddObject(int handle);
+
+	/**
+	 * Removes a tile from every leaf it was added to. Sibling leaves that end up holding no more than
+	 * objectsPerNode tiles between them are collapsed back into their parent; they split again lazily as
+	 * tiles are added.
+	 *
+	 * @param handle The tile to remove.
+	 * @param oldBounds The bounds the tile had when it was added.
+	 *
+	 * @return true if the tile was found.
+	 */
+	bool RemoveObject(int handle, const AABBf& oldBounds);
+
+	/**
+	 * Removes a tile using its current bounds.
+	 *
+	 * @param handle The tile to remove.
+	 *
+	 * @return true if the tile was found.
+	 */
+	bool RemoveObject(int handle);
+
+	/**
+	 * Re-files a tile whose bounds have changed since it was added.
+	 *
+	 * @param handle The tile to update.
+	 * @param oldBounds The bounds the tile had when it was added.
+	 */
+	void UpdateObject(int handle, const AABBf& oldBounds);
+
+	/**
+	 * Moves a tile to a new location, updating its bounds and its place in the tree.
+	 *
+	 * @param handle The tile to move.
+	 * @param newLocation The new location of the tile.
+	 */
+	void MoveObject(int handle, const Vector2f& newLocation);
+
+	/**
+	 * Finds the contents of the leaf that contains the target location. The result refers to the tree's own
+	 * storage and is only valid until the tree is next modified.
+	 *
+	 * @param target The location to search for.
+	 *
+	 * @return The handles of the tiles that could affect the target location.
+	 */
+	const std::vector<int>& FindTiles(const Vector2f& target) const;
+
+	/**
+	 * Calls the visitor for every tile in the leaf that contains the target location.
+	 *
+	 * @param target The location to search for.
+	 * @param visitor Callable taking a tile handle.
+	 */
+	template <typename Visitor>
+	void VisitTiles(const Vector2f& target, Visitor&& visitor) const;
+
+	/**
+	 * Calls the visitor exactly once for every tile whose bounds overlap the range inside the tree's bounds.
+	 * Does not allocate.
+	 *
+	 * @param range The area to search.
+	 * @param visitor Callable taking a tile handle.
+	 */
+	template <typename Visitor>
+	void QueryRange(const AABBf& range, Visitor&& visitor) const;
+
+	/**
+	 * Calls the visitor for every node, leaf or not, whose bounds overlap the range, in depth first order. Subtrees
+	 * outside the range are skipped.
+	 *
+	 * @param range The area to search.
+	 * @param visitor Callable taking the node's index and a const QuadNode&.
+	 */
+	template <typename Visitor>
+	void VisitNodes(const AABBf& range, Visitor&& visitor) const;
+
+	/**
+	 * Calls the visitor for every leaf in the tree, in depth first order.
+	 *
+	 * @param visitor Callable taking the leaf's index and a const QuadNode&.
+	 */
+	template <typename Visitor>
+	void VisitLeaves(Visitor&& visitor) const;
+
+	/**
+	 * Finds the leaf that contains the target location.
+	 *
+	 * @param target The location to search for.
+	 *
+	 * @return The index of the leaf, or -1 if the tree is empty.
+	 */
+	int FindLeaf(const Vector2f& target) const;
+
+	/**
+	 * Gets the number of nodes currently in use.
+	 *
+	 * @return The number of nodes in the tree.
+	 */
+	int NodeCount() const { return nodeCount - static_cast<int>(freeBlocks.size()) * 4; }
+
+	/**
+	 * Gets a node by index. The root node is always index 0.
+	 *
+	 * @param index The index of the node.
+	 *
+	 * @return The node.
+	 */
+	const QuadNode& GetNode(int index) const { return nodes[index]; }
+
+public:
+	float minNodeWidth = 1;
+
+	/** Subtrees with fewer tiles than this are always built on the calling thread. */
+	static const size_t ParallelBuildCutoff = 4096;
+
+protected:
+	void AddObject(int nodeIndex, int handle);
+	bool RemoveObject(int nodeIndex, int handle, const AABBf& oldBounds);
+	void Split(int nodeIndex);
+	void SetChildBounds(int nodeIndex, int firstChild);
+	void BuildSubtree(int nodeIndex, std::vector<int>& handles, unsigned taskBudget);
+	void SpliceSubtree(QuadTree& subtree, int nodeIndex);
+	void TryCollapse(int nodeIndex);
+	int AllocateChildren(int parentIndex);
+
+	template <typename Visitor>
+	void QueryRange(int nodeIndex, const AABBf& range, Visitor& visitor) const;
+
+	template <typename Visitor>
+	void VisitNodes(int nodeIndex, const AABBf& range, Visitor& visitor) const;
+
+	template <typename Visitor>
+	void VisitLeaves(int nodeIndex, Visitor& visitor) const;
+
+protected:
+	std::vector<Tile>* tiles = nullptr;
+	std::vector<QuadNode> nodes;
+	std::vector<int> freeBlocks;
+	int nodeCount = 0;
+	unsigned objectsPerNode = 5;
+};
+
+template <typename Visitor>
+void QuadTree::VisitTiles(const Vector2f& target, Visitor&& visitor) const
+{
+	for (int handle : FindTiles(target))
+	{
+		visitor(handle);
+	}
+}
+
+template <typename Visitor>
+void QuadTree::QueryRange(const AABBf& range, Visitor&& visitor) const
+{
+	if (nodeCount == 0)
+		return;
+
+	QueryRange(0, range, visitor);
+}
+
+template <typename Visitor>
+void QuadTree::QueryRange(int nodeIndex, const AABBf& range, Visitor& visitor) const
+{
+	const QuadNode& node = nodes[nodeIndex];
+	if (!node.boundingBox.Intersects(range))
+		return;
+
+	if (!node.IsLeaf())
+	{
+		for (int childIndex = node.firstChild; childIndex < node.firstChild + 4; ++childIndex)
+		{
+			QueryRange(childIndex, range, visitor);
+		}
+		return;
+	}
+
+	for (int handle : node.contents)
+	{
+		const Tile& tile = (*tiles)[handle];
+		if (!tile.bounds.Intersects(range))
+			continue;
+
+		// a tile is stored in every leaf it overlaps, so only report it from the leaf that owns the
+		// lower corner of its overlap with the range (and the tree)
+		const AABBf& treeBounds = nodes[0].boundingBox;
+		const Vector2f overlapCorner(std::max(std::max(tile.bounds.boxMin.X, range.boxMin.X), treeBounds.boxMin.X),
+									 std::max(std::max(tile.bounds.boxMin.Y, range.boxMin.Y), treeBounds.boxMin.Y));
+		if (FindLeaf(overlapCorner) == nodeIndex)
+			visitor(handle);
+	}
+}
+
+template <typename Visitor>
+void QuadTree::VisitNodes(const AABBf& range, Visitor&& visitor) const
+{
+	if (nodeCount == 0)
+		return;
+
+	VisitNodes(0, range, visitor);
+}
+
+template <typename Visitor>
+void QuadTree::VisitNodes(int nodeIndex, const AABBf& range, Visitor& visitor) const
+{
+	const QuadNode& node = nodes[nodeIndex];
+	if (!node.boundingBox.Intersects(range))
+		return;
+
+	visitor(nodeIndex, node);
+	if (node.IsLeaf())
+		return;
+
+	for (int childIndex = node.firstChild; childIndex < node.firstChild + 4; ++childIndex)
+	{
+		VisitNodes(childIndex, range, visitor);
+	}
+}
+
+template <typename Visitor>
+void QuadTree::VisitLeaves(Visitor&& visitor) const
+{
+	if (nodeCount == 0)
+		return;
+
+	VisitLeaves(0, visitor);
+}
+
+template <typename Visitor>
+void QuadTree::VisitLeaves(int nodeIndex, Visitor& visitor) const
+{
+	const QuadNode& node = nodes[nodeIndex];
+	if (node.IsLeaf())
+	{
+		visitor(nodeIndex, node);
+		return;
+	}
+
+	for (int childIndex = node.firstChild; childIndex < node.firstChild + 4; ++childIndex)
+	{
+		VisitLeaves(childIndex, visitor);
+	}
+}
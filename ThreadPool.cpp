@@ -0,0 +1,92 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threadCount) :
+	nextTask(0)
+{
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	for (unsigned threadIndex = 1; threadIndex < threadCount; ++threadIndex)
+	{
+		workers.emplace_back(&ThreadPool::WorkerLoop, this, threadIndex);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeWorkers.notify_all();
+
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::ParallelFor(int taskCount, const std::function<void(int, unsigned)>& task)
+{
+	// nothing to share out, so skip waking the workers
+	if (workers.empty() || taskCount <= 1)
+	{
+		for (int taskIndex = 0; taskIndex < taskCount; ++taskIndex)
+		{
+			task(taskIndex, 0);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		batchTask = &task;
+		batchTaskCount = taskCount;
+		nextTask = 0;
+		busyWorkers = static_cast<unsigned>(workers.size());
+		++batchGeneration;
+	}
+	wakeWorkers.notify_all();
+
+	RunTasks(task, taskCount, 0);
+
+	// the task is owned by the caller, so every worker has to be done with it before returning
+	std::unique_lock<std::mutex> lock(mutex);
+	batchDone.wait(lock, [this]() { return busyWorkers == 0; });
+	batchTask = nullptr;
+}
+
+void ThreadPool::WorkerLoop(unsigned threadIndex)
+{
+	unsigned seenGeneration = 0;
+	for (;;)
+	{
+		const std::function<void(int, unsigned)>* task;
+		int taskCount;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeWorkers.wait(lock, [this, seenGeneration]() { return stopping || batchGeneration != seenGeneration; });
+			if (stopping)
+				return;
+
+			seenGeneration = batchGeneration;
+			task = batchTask;
+			taskCount = batchTaskCount;
+		}
+
+		RunTasks(*task, taskCount, threadIndex);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busyWorkers == 0)
+			batchDone.notify_one();
+	}
+}
+
+void ThreadPool::RunTasks(const std::function<void(int, unsigned)>& task, int taskCount, unsigned threadIndex)
+{
+	for (int taskIndex = nextTask++; taskIndex < taskCount; taskIndex = nextTask++)
+	{
+		task(taskIndex, threadIndex);
+	}
+}
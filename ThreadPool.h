@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads that run batches of indexed tasks. The threads are started once and sleep between
+ * batches, so handing out a batch costs a wake up rather than a thread creation.
+ */
+class ThreadPool
+{
+public:
+	/**
+	 * Starts the pool. The thread calling ParallelFor always takes part, so threadCount - 1 workers are started.
+	 *
+	 * @param threadCount The number of threads to run tasks on, 0 to use every hardware thread.
+	 */
+	explicit ThreadPool(unsigned threadCount);
+
+	/**
+	 * Stops and joins the workers.
+	 */
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/**
+	 * Runs task(taskIndex, threadIndex) for every taskIndex in [0, taskCount) and waits for them all to finish.
+	 * Tasks are handed out in index order but may finish in any order. threadIndex is in [0, ThreadCount()) and
+	 * identifies the thread running the task, so it can be used to index per-thread results. Not reentrant.
+	 *
+	 * @param taskCount The number of tasks.
+	 * @param task Callable taking the task index and the thread index.
+	 */
+	void ParallelFor(int taskCount, const std::function<void(int, unsigned)>& task);
+
+	/**
+	 * Gets the number of threads tasks are run on, including the calling thread.
+	 *
+	 * @return The number of threads.
+	 */
+	unsigned ThreadCount() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+protected:
+	void WorkerLoop(unsigned threadIndex);
+	void RunTasks(const std::function<void(int, unsigned)>& task, int taskCount, unsigned threadIndex);
+
+protected:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wakeWorkers;
+	std::condition_variable batchDone;
+
+	const std::function<void(int, unsigned)>* batchTask = nullptr;
+	int batchTaskCount = 0;
+	unsigned batchGeneration = 0;
+	unsigned busyWorkers = 0;
+	bool stopping = false;
+	std::atomic<int> nextTask;
+};
@@ -23,29 +23,56 @@ class Tile
         float FieldRange = 0;
 		AABBf bounds;
 
+        // the palette entry the tile was generated (or last set) as, -1 if it isn't one
+        int PaletteIndex = -1;
+
         Vector2f LocalFieldValue;
 
         Tile(TileType _type, const ImColor& _colour, const Vector2f& _location, float _fieldStrength, float _fieldRange) :
             Type(_type), Colour(_colour), Location(_location), FieldStrength(_fieldStrength), FieldRange(_fieldRange)
         {
-			bounds = AABBf(_location + Vector2f(_fieldRange * -1, _fieldRange * -1), _location + Vector2f(_fieldRange, _fieldRange));
+			UpdateBounds();
         }
 
-        Vector2f CalculateFieldTo(Tile* otherTile)
+        void SetType(TileType _type, const ImColor& _colour, float _fieldStrength, float _fieldRange)
+        {
+            Type = _type;
+            Colour = _colour;
+            FieldStrength = _fieldStrength;
+            FieldRange = _fieldRange;
+
+            UpdateBounds();
+        }
+
+        void UpdateBounds()
+        {
+			bounds = AABBf(Location + Vector2f(FieldRange * -1, FieldRange * -1), Location + Vector2f(FieldRange, FieldRange));
+        }
+
+        bool EmitsField() const
+        {
+            // a tile with no strength or no range never contributes to another tile's field
+            return (FieldStrength != 0) && (FieldRange > 0);
+        }
+
+        Vector2f CalculateFieldTo(const Tile& otherTile) const
         {
             // does this tile not apply a field?
             if (FieldStrength == 0)
                 return Vector2f::Zero;
 
             // calculate the vector to the other tile
-            Vector2f vecToTile = otherTile->Location - Location;
+            return CalculateFieldAt(otherTile.Location - Location, FieldStrength, FieldRange);
+        }
 
+        static Vector2f CalculateFieldAt(Vector2f vecToTile, float fieldStrength, float fieldRange)
+        {
             // is the other tile too far away?
             float distToTile = vecToTile.Normalise();
-            if (distToTile >= FieldRange)
+            if (distToTile >= fieldRange)
                 return Vector2f::Zero;
 
             // calculate and return the field strength
-            return vecToTile * FieldStrength * (1.0f - (distToTile / FieldRange));
+            return vecToTile * fieldStrength * (1.0f - (distToTile / fieldRange));
         }
 };
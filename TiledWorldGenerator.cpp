@@ -1,19 +1,34 @@
 #include "TiledWorldGenerator.h"
 #include "Tile.h"
-#include "imgui_internal.h"
+#include "CounterRandom.h"
+#include "Profiler.h"
 #include <iostream>
 #include <algorithm>
+#include <cmath>
 #include <vector>
 
-const float WindowBuffer = 5.0f;
-const float CellBorder = 1.0f;
-
 void TiledWorldGenerator::Generate()
 {
+	PROFILE_SCOPE("Generate");
+
 	// perform the world generation
 	NormaliseProbabilities();
 	ClearWorld();
 	GenerateWorld();
+
+	// the tree refers to the old tiles so it needs building from scratch, as do the field layers and chunks
+	ResetChunks(chunkCache.Capacity());
+
+	// the old dirty region may lie outside the new world
+	++worldGeneration;
+	dirtyPixelsMaxX = -1;
+	MarkPixelsDirty(0, worldLength - 1, 0, worldWidth - 1);
+	fieldValid = false;
+	treeDirty = true;
+	for (FieldLayer& layer : fieldLayers)
+	{
+		layer.Dirty = true;
+	}
 }
 
 /*
@@ -56,176 +71,1219 @@ Process (for using)
 	 - Run "Find potential relevant tiles" on that child and return the result
 */
 
+void TiledWorldGenerator::BuildTree()
+{
+	PROFILE_SCOPE("BuildTree");
+
+	AABBf worldBounds = AABBf(Vector2f::Zero, Vector2f(worldLength, worldWidth));
+
+	treeDirty = false;
+	treeBulkLoaded = BulkLoadTree;
+	emitterArraysDirty = true;
+
+	// only tiles that emit a field are worth finding, the rest are just receivers
+	emitters.clear();
+	for (int tileIndex = 0; tileIndex < (int)world.size(); ++tileIndex)
+	{
+		if (world[tileIndex].EmitsField())
+			emitters.push_back(tileIndex);
+	}
+
+	// the linear tree is built in a few sorting passes instead of one insertion per tile
+	if (BulkLoadTree)
+	{
+		linearTree.Build(worldBounds, world, emitters);
+		return;
+	}
+
+	// the tree reuses its node pool, so rebuilding does not allocate a node per split, and the
+	// quadrants of large nodes are built on separate threads
+	tree.BuildParallel(worldBounds, world, emitters, ThreadCount);
+}
+
+void TiledWorldGenerator::SetTileType(int x, int y, const AvailableTile& tileType)
+{
+	if (x < 0 || x >= worldLength || y < 0 || y >= worldWidth)
+		return;
+
+	if (worldCompact)
+	{
+		SetCompactTileType(x, y, tileType);
+		return;
+	}
+
+	// the layers group tiles by palette entry, so a tile has to be one
+	const int paletteIndex = FindPaletteIndex(tileType);
+	if (paletteIndex < 0)
+		return;
+
+	const int handle = (x * worldWidth) + y;
+	Tile& tile = world[handle];
+	const AABBf oldBounds = tile.bounds;
+	const bool wasEmitter = tile.EmitsField();
+	const float oldStrength = tile.FieldStrength;
+	const float oldRange = tile.FieldRange;
+
+	const int oldPaletteIndex = tile.PaletteIndex;
+	tile.SetType(tileType.Type, tileType.Colour, tileType.FieldStrength, tileType.FieldRange);
+	tile.PaletteIndex = paletteIndex;
+	emitterArraysDirty = true;
+	++worldGeneration;
+	MarkPixelsDirty(x, x, y, y);
+
+	if (fieldValid)
+		PatchField(x, y, wasEmitter, oldStrength, oldRange);
+
+	// the layers of both the old and the new entry have changed
+	for (int layerIndex : { oldPaletteIndex, paletteIndex })
+	{
+		if (layerIndex >= 0 && layerIndex < (int)fieldLayers.size())
+			fieldLayers[layerIndex].Dirty = true;
+	}
+
+	// the linear tree can't be patched, so leave it to be rebuilt
+	if (treeDirty || treeBulkLoaded)
+	{
+		treeDirty = true;
+		return;
+	}
+
+	// the tree only holds emitters, so the tile may be entering or leaving it
+	if (wasEmitter && tile.EmitsField())
+		tree.UpdateObject(handle, oldBounds);
+	else if (wasEmitter)
+		tree.RemoveObject(handle, oldBounds);
+	else if (tile.EmitsField())
+		tree.AddObject(handle);
+}
+
+int TiledWorldGenerator::FindPaletteIndex(const AvailableTile& tileType) const
+{
+	// by address, as entries may share a type but not a strength or range
+	for (int paletteIndex = 0; paletteIndex < (int)TilePalette.size(); ++paletteIndex)
+	{
+		if (TilePalette[paletteIndex] == &tileType)
+			return paletteIndex;
+	}
+
+	return -1;
+}
+
+void TiledWorldGenerator::SetCompactTileType(int x, int y, const AvailableTile& tileType)
+{
+	const int paletteIndex = FindPaletteIndex(tileType);
+	if (paletteIndex < 0)
+		return;
+
+	const int cellIndex = (x * worldWidth) + y;
+	const bool wasEmitter = CellEmitsField(cellIndex);
+	const float oldStrength = GetCellFieldStrength(cellIndex);
+	const float oldRange = GetCellFieldRange(cellIndex);
+
+	// there are no trees or layers to keep up to date, only the field
+	cellPalette[cellIndex] = (uint8_t)paletteIndex;
+	++worldGeneration;
+	MarkPixelsDirty(x, x, y, y);
+	if (fieldValid)
+		PatchField(x, y, wasEmitter, oldStrength, oldRange);
+}
+
 void TiledWorldGenerator::CalculateField()
 {
+	PROFILE_SCOPE("CalculateField");
+
 	largestFieldStrength = 0;
 
-	AABBf worldBounds = AABBf(Vector2f::Zero, Vector2f(Length, Width));
+	fieldMode = worldCompact ? efmScatter : FieldCalculationMode;
+	switch (fieldMode)
+	{
+		case efmScatter:
+			ScatterField();
+			break;
+
+		case efmConvolution:
+			ConvolveField();
+			break;
+
+		case efmLayered:
+			LayeredField();
+			break;
+
+		case efmAggregate:
+			AggregateField();
+			break;
 
-	// TODO: build tree here
-	rootNode = new Node(worldBounds.boxMin, worldBounds.boxMax, nullptr, 0);
+		default:
+			GatherField();
+			break;
+	}
+
+	RebuildFieldBlocks();
+}
+
+void TiledWorldGenerator::PatchField(int x, int y, bool wasEmitter, float oldStrength, float oldRange)
+{
+	PROFILE_SCOPE("PatchField");
+
+	// the approximate field has no exact contribution to take away, so it waits for the next CalculateField
+	if (fieldMode == efmAggregate)
+	{
+		fieldValid = false;
+		approximationError = -1;
+		return;
+	}
+
+	const int tileIndex = (x * worldWidth) + y;
+	const int maxRadius = std::max(worldLength, worldWidth) - 1;
+
+	// take the old emission away from every receiver it reached and add the new one
+	int reach = 0;
+	if (wasEmitter)
+	{
+		StampTileField(x, y, -oldStrength, oldRange);
+		reach = std::max(reach, FieldStencil::RadiusFor(oldRange, maxRadius));
+	}
+	if (CellEmitsField(tileIndex))
+	{
+		StampTileField(x, y, GetCellFieldStrength(tileIndex), GetCellFieldRange(tileIndex));
+		reach = std::max(reach, FieldStencil::RadiusFor(GetCellFieldRange(tileIndex), maxRadius));
+	}
 
-	for (auto tile : world)
+	// the tile's own field doesn't depend on what it emits, but it may have become (or stopped being) an obstacle
+	Vector2f& field = GetCellField(tileIndex);
+	field = Vector2f::Zero;
+	if (GetCellType(tileIndex) != ettObstructed)
+	{
+		int gatherReach = 0;
+		for (AvailableTile* entryPtr : TilePalette)
+		{
+			gatherReach = std::max(gatherReach, FieldStencil::RadiusFor(entryPtr->FieldRange, maxRadius));
+		}
+
+		for (int otherX = std::max(x - gatherReach, 0); otherX <= std::min(x + gatherReach, worldLength - 1); ++otherX)
+		{
+			for (int otherY = std::max(y - gatherReach, 0); otherY <= std::min(y + gatherReach, worldWidth - 1); ++otherY)
+			{
+				const int otherIndex = (otherX * worldWidth) + otherY;
+				if (otherIndex != tileIndex && CellEmitsField(otherIndex))
+				{
+					const Vector2f vecToTile((float)(x - otherX), (float)(y - otherY));
+					field += Tile::CalculateFieldAt(vecToTile, GetCellFieldStrength(otherIndex), GetCellFieldRange(otherIndex));
+				}
+			}
+		}
+	}
+
+	// only the blocks (and pixels) the edit reached can have changed
+	UpdateFieldBlocks(x - reach, x + reach, y - reach, y + reach);
+	++fieldGeneration;
+	MarkPixelsDirty(x - reach, x + reach, y - reach, y + reach);
+
+	largestFieldStrength = 0;
+	for (float blockLargest : blockLargestField)
 	{
-		rootNode->AddObject(tile);
+		largestFieldStrength = std::max(largestFieldStrength, blockLargest);
 	}
+}
+
+void TiledWorldGenerator::StampTileField(int x, int y, float fieldStrength, float fieldRange)
+{
+	const int reach = FieldStencil::RadiusFor(fieldRange, std::max(worldLength, worldWidth) - 1);
+
+	for (int receiverX = std::max(x - reach, 0); receiverX <= std::min(x + reach, worldLength - 1); ++receiverX)
+	{
+		for (int receiverY = std::max(y - reach, 0); receiverY <= std::min(y + reach, worldWidth - 1); ++receiverY)
+		{
+			const int receiverIndex = (receiverX * worldWidth) + receiverY;
+
+			// skip the tile itself and obstacles, which never have a field
+			if ((receiverX == x && receiverY == y) || GetCellType(receiverIndex) == ettObstructed)
+				continue;
+
+			const Vector2f vecToTile((float)(receiverX - x), (float)(receiverY - y));
+			GetCellField(receiverIndex) += Tile::CalculateFieldAt(vecToTile, fieldStrength, fieldRange);
+		}
+	}
+}
+
+void TiledWorldGenerator::RebuildFieldBlocks()
+{
+	fieldValid = true;
+	++fieldGeneration;
+	MarkPixelsDirty(0, worldLength - 1, 0, worldWidth - 1);
+
+	fieldBlockRows = (worldLength + FieldBlockSize - 1) / FieldBlockSize;
+	fieldBlockColumns = (worldWidth + FieldBlockSize - 1) / FieldBlockSize;
+	blockLargestField.assign(fieldBlockRows * fieldBlockColumns, 0.0f);
+
+	GetThreadPool().ParallelFor(fieldBlockRows, [this](int blockX, unsigned)
+	{
+		UpdateFieldBlocks(blockX * FieldBlockSize, (blockX * FieldBlockSize) + FieldBlockSize - 1, 0, worldWidth - 1);
+	});
+}
+
+void TiledWorldGenerator::UpdateFieldBlocks(int minX, int maxX, int minY, int maxY)
+{
+	// widen the area out to whole blocks
+	const int firstBlockX = std::max(minX, 0) / FieldBlockSize;
+	const int lastBlockX = std::min(maxX, worldLength - 1) / FieldBlockSize;
+	const int firstBlockY = std::max(minY, 0) / FieldBlockSize;
+	const int lastBlockY = std::min(maxY, worldWidth - 1) / FieldBlockSize;
+
+	for (int blockX = firstBlockX; blockX <= lastBlockX; ++blockX)
+	{
+		for (int blockY = firstBlockY; blockY <= lastBlockY; ++blockY)
+		{
+			float blockLargest = 0;
+			for (int x = blockX * FieldBlockSize; x < std::min((blockX + 1) * FieldBlockSize, worldLength); ++x)
+			{
+				for (int y = blockY * FieldBlockSize; y < std::min((blockY + 1) * FieldBlockSize, worldWidth); ++y)
+				{
+					blockLargest = std::max(blockLargest, GetCellField((x * worldWidth) + y).Magnitude());
+				}
+			}
+			blockLargestField[(blockX * fieldBlockColumns) + blockY] = blockLargest;
+		}
+	}
+}
+
+void TiledWorldGenerator::GatherField()
+{
+	PROFILE_SCOPE("GatherField");
+
+	// the tree persists between calls and is only rebuilt when the world is regenerated
+	if (treeDirty || treeBulkLoaded != BulkLoadTree)
+		BuildTree();
 	
+	// lay the emitters out in tree order so each query is a contiguous run of the arrays
+	if (emitterArraysDirty)
+		PackEmitterArrays();
+
+	const KernelIsa kernelIsa = FieldKernel::Resolve(GatherKernel);
+
+	// every receiver only reads the tree, so blocks of rows can be run on separate threads
+	ForEachRowBlock([this, kernelIsa](int firstRow, int endRow, float& largestField)
+	{
+		GatherRows(firstRow, endRow, kernelIsa, largestField);
+	});
+}
+
+void TiledWorldGenerator::GatherRows(int firstRow, int endRow, KernelIsa kernelIsa, float& largestField)
+{
+	PROFILE_SCOPE("GatherRows");
+
 	// iterate over the tiles and calculate their field
-	for (Tile* currentTilePtr : world)
+	for (int tileIndex = firstRow * worldWidth; tileIndex < endRow * worldWidth; ++tileIndex)
 	{
-		// reset the field
-		currentTilePtr->LocalFieldValue = Vector2f::Zero;
+		Tile& currentTile = world[tileIndex];
 
-		Vector2f boxSize = Vector2f(currentTilePtr->FieldRange, currentTilePtr->FieldRange);
-		AABBf boundingBox(currentTilePtr->Location - boxSize, 
-			              currentTilePtr->Location + boxSize);
+		// reset the field
+		currentTile.LocalFieldValue = Vector2f::Zero;
 
 		// is this an obstacle? if so do nothing
-		if (currentTilePtr->Type == ettObstructed)
+		if (currentTile.Type == ettObstructed)
 			continue;
 
-		// TODO: "world" below changes to result we get back from asking for relevant tiles
+		// add the contribution of every emitter in the matching node (the kernel skips this tile itself)
+		const Vector2f location = currentTile.Location;
+		Vector2f& field = currentTile.LocalFieldValue;
+		if (treeBulkLoaded)
+		{
+			linearTree.VisitRanges(location, [this, kernelIsa, &location, &field](int begin, int end)
+			{
+				FieldKernel::Accumulate(kernelIsa, emitterArrays, begin, end, location, field);
+			});
+		}
+		else
+		{
+			const int leafIndex = tree.FindLeaf(location);
+			if (leafIndex >= 0 && leafIndex < (int)leafEmitterStart.size())
+				FieldKernel::Accumulate(kernelIsa, emitterArrays, leafEmitterStart[leafIndex], leafEmitterEnd[leafIndex], location, field);
+		}
+
+		// track the largest field strength
+		float fieldStrength = field.Magnitude();
+		if (fieldStrength > largestField)
+			largestField = fieldStrength;
+	}
+}
 
-		// iterate over every other tile and add their contribution to the field
+void TiledWorldGenerator::PackEmitterArrays()
+{
+	emitterArraysDirty = false;
+	emitterArrays.Clear();
 
-		//for(Tile* otherTilePtr : world)
-		for (Tile* otherTilePtr : rootNode->FindTiles(currentTilePtr->Location))
+	// the linear tree's queries are already spans of its sorted tiles
+	if (treeBulkLoaded)
+	{
+		for (int handle : linearTree.SortedHandles())
 		{
-			// skip this tile
-			if (otherTilePtr == currentTilePtr)
-				continue;
+			emitterArrays.Add(world[handle]);
+		}
+		return;
+	}
 
-			currentTilePtr->LocalFieldValue += otherTilePtr->CalculateFieldTo(currentTilePtr);
+	// otherwise record where each leaf's contents start and end
+	int lastLeaf = -1;
+	tree.VisitLeaves([&lastLeaf](int leafIndex, const QuadNode&)
+	{
+		lastLeaf = std::max(lastLeaf, leafIndex);
+	});
+
+	leafEmitterStart.assign(lastLeaf + 1, 0);
+	leafEmitterEnd.assign(lastLeaf + 1, 0);
+
+	tree.VisitLeaves([this](int leafIndex, const QuadNode& leaf)
+	{
+		leafEmitterStart[leafIndex] = emitterArrays.Size();
+		for (int handle : leaf.contents)
+		{
+			emitterArrays.Add(world[handle]);
 		}
+		leafEmitterEnd[leafIndex] = emitterArrays.Size();
+	});
+}
 
-		// track the largest field strength
-		float fieldStrength = currentTilePtr->LocalFieldValue.Magnitude();
-		if (fieldStrength > largestFieldStrength)
-			largestFieldStrength = fieldStrength;
+void TiledWorldGenerator::ScatterField()
+{
+	PROFILE_SCOPE("ScatterField");
+
+	// accumulate into a flat buffer laid out the same way as the world, a compact world's fields already are one
+	const int cellCount = worldLength * worldWidth;
+	std::vector<Vector2f>& buffer = worldCompact ? cellFields : fieldBuffer;
+	buffer.assign(cellCount, Vector2f::Zero);
+
+	// find the emitters and their stencils up front, in world order, so the row blocks only read shared state
+	const int maxReach = LookUpCellStencils();
+
+	scatterEmitters.clear();
+	for (int emitterIndex = 0; emitterIndex < cellCount; ++emitterIndex)
+	{
+		if (GetCellStencil(emitterIndex))
+			scatterEmitters.push_back(emitterIndex);
 	}
+
+	// each block only stamps onto its own rows, so no two threads ever write to the same cell
+	ForEachRowBlock([this, maxReach, &buffer](int firstRow, int endRow, float& largestField)
+	{
+		ScatterRows(firstRow, endRow, maxReach, buffer);
+		CopyFieldOut(firstRow, endRow, largestField);
+	});
 }
 
-void TiledWorldGenerator::DrawWorld()
+void TiledWorldGenerator::ScatterRows(int firstRow, int endRow, int maxReach, std::vector<Vector2f>& buffer)
 {
-	// early out if there is no world
-	if (world.size() == 0)
+	PROFILE_SCOPE("ScatterRows");
+
+	// emitters are in world order, i.e. sorted by row, so the ones that can reach these rows are a contiguous run
+	const int firstEmitterIndex = std::max(firstRow - maxReach, 0) * worldWidth;
+	const int endEmitterIndex = std::min(endRow + maxReach, worldLength) * worldWidth;
+	auto firstEmitter = std::lower_bound(scatterEmitters.begin(), scatterEmitters.end(), firstEmitterIndex);
+	auto endEmitter = std::lower_bound(firstEmitter, scatterEmitters.end(), endEmitterIndex);
+
+	// emitters stamp their field onto the cells in range, in world order so every cell adds up its
+	// contributions in the same order as the gather
+	for (auto emitterIt = firstEmitter; emitterIt != endEmitter; ++emitterIt)
+	{
+		const int emitterIndex = *emitterIt;
+		const FieldStencil* stencilPtr = GetCellStencil(emitterIndex);
+
+		const int reach = stencilPtr->Radius;
+		const int emitterX = emitterIndex / worldWidth;
+		const int emitterY = emitterIndex % worldWidth;
+
+		const int minX = std::max(emitterX - reach, firstRow);
+		const int maxX = std::min(emitterX + reach, endRow - 1);
+		const int minY = std::max(emitterY - reach, 0);
+		const int maxY = std::min(emitterY + reach, worldWidth - 1);
+
+		for (int x = minX; x <= maxX; ++x)
+		{
+			for (int y = minY; y <= maxY; ++y)
+			{
+				const int receiverIndex = (x * worldWidth) + y;
+
+				// skip this tile and obstacles, which never have a field
+				if (receiverIndex == emitterIndex || GetCellType(receiverIndex) == ettObstructed)
+					continue;
+
+				buffer[receiverIndex] += stencilPtr->At(x - emitterX, y - emitterY);
+			}
+		}
+	}
+}
+
+void TiledWorldGenerator::CopyFieldOut(int firstRow, int endRow, float& largestField)
+{
+	// a compact world was scattered in place, and never onto obstacles
+	if (worldCompact)
+	{
+		for (int cellIndex = firstRow * worldWidth; cellIndex < endRow * worldWidth; ++cellIndex)
+		{
+			largestField = std::max(largestField, cellFields[cellIndex].Magnitude());
+		}
 		return;
+	}
 
-	// grab the window
-    ImGuiWindow* window = ImGui::GetCurrentWindowRead();
-	
-	// determine the cell size
-	ImVec2 windowSize = ImGui::GetWindowSize();
-	int cellSize = (int) std::min((windowSize.x - (WindowBuffer * 2)) / Length, (windowSize.y - window->TitleBarHeight() - (WindowBuffer * 2)) / Width);
+	// copy the field out to the tiles and track the largest field strength, obstacles never have a field
+	for (int tileIndex = firstRow * worldWidth; tileIndex < endRow * worldWidth; ++tileIndex)
+	{
+		Tile& tile = world[tileIndex];
+		tile.LocalFieldValue = (tile.Type == ettObstructed) ? Vector2f::Zero : fieldBuffer[tileIndex];
+
+		float fieldStrength = tile.LocalFieldValue.Magnitude();
+		if (fieldStrength > largestField)
+			largestField = fieldStrength;
+	}
+}
+
+void TiledWorldGenerator::ConvolveField()
+{
+	PROFILE_SCOPE("ConvolveField");
+
+	LookUpCellStencils();
+
+	// every emitter sharing a stencil is added in one convolution, so the cost doesn't depend on the range
+	fieldConvolution.Calculate(worldLength, worldWidth, cellStencils, fieldBuffer, GetThreadPool());
+
+	ForEachRowBlock([this](int firstRow, int endRow, float& largestField)
+	{
+		CopyFieldOut(firstRow, endRow, largestField);
+	});
+}
+
+void TiledWorldGenerator::LayeredField()
+{
+	PROFILE_SCOPE("LayeredField");
+
+	// only the layers whose tiles or range have changed need building again
+	fieldLayers.resize(TilePalette.size());
+	for (int paletteIndex = 0; paletteIndex < (int)TilePalette.size(); ++paletteIndex)
+	{
+		const FieldLayer& layer = fieldLayers[paletteIndex];
+		if (layer.Dirty || layer.Values.size() != world.size() || layer.FieldRange != TilePalette[paletteIndex]->FieldRange)
+			BuildFieldLayer(paletteIndex);
+	}
+
+	ComposeFieldLayers();
+}
+
+void TiledWorldGenerator::BuildFieldLayer(int paletteIndex)
+{
+	const AvailableTile* entryPtr = TilePalette[paletteIndex];
+	FieldLayer& layer = fieldLayers[paletteIndex];
+
+	layer.FieldRange = entryPtr->FieldRange;
+	layer.Dirty = false;
+	layer.Values.assign(world.size(), Vector2f::Zero);
 
-	// get the draw list to update
-	ImDrawList* drawList = ImGui::GetWindowDrawList();
+	const int maxRadius = std::max(worldLength, worldWidth) - 1;
+	if (FieldStencil::RadiusFor(entryPtr->FieldRange, maxRadius) <= 0)
+		return;
+
+	// scatter every tile of this entry at unit strength, whatever its strength is now
+	const FieldStencil* unitStencilPtr = &GetFieldStencil(1.0f, entryPtr->FieldRange);
+
+	cellStencils.assign(world.size(), nullptr);
+	scatterEmitters.clear();
+	for (int emitterIndex = 0; emitterIndex < (int)world.size(); ++emitterIndex)
+	{
+		// by entry rather than type, as entries may share a type
+		if (world[emitterIndex].PaletteIndex != paletteIndex)
+			continue;
+
+		cellStencils[emitterIndex] = unitStencilPtr;
+		scatterEmitters.push_back(emitterIndex);
+	}
 
-	// get the window pos
-	ImVec2 startPoint = ImGui::GetWindowPos();
-	startPoint.x += WindowBuffer;
-	startPoint.y += window->TitleBarHeight() + WindowBuffer;
+	ForEachRowBlock([this, unitStencilPtr, &layer](int firstRow, int endRow, float&)
+	{
+		ScatterRows(firstRow, endRow, unitStencilPtr->Radius, layer.Values);
+	});
+}
 
-	// draw the tiles
-	for(Tile* tilePtr : world)
+void TiledWorldGenerator::ComposeFieldLayers()
+{
+	largestFieldStrength = 0;
+
+	// the field is linear in the strength, so it is the layers weighted by the current strengths
+	ForEachRowBlock([this](int firstRow, int endRow, float& largestField)
 	{
-		// calculate the tile location
-		ImVec2 location = ImVec2((tilePtr->Location.X * cellSize) + startPoint.x, (tilePtr->Location.Y * cellSize) + startPoint.y);
-		ImColor workingColour = tilePtr->Colour;
+		for (int tileIndex = firstRow * worldWidth; tileIndex < endRow * worldWidth; ++tileIndex)
+		{
+			Vector2f field = Vector2f::Zero;
+			for (int paletteIndex = 0; paletteIndex < (int)fieldLayers.size(); ++paletteIndex)
+			{
+				const float fieldStrength = TilePalette[paletteIndex]->FieldStrength;
+				if (fieldStrength != 0 && fieldLayers[paletteIndex].FieldRange > 0)
+					field += fieldLayers[paletteIndex].Values[tileIndex] * fieldStrength;
+			}
+
+			// layers never stamp onto obstacles, so they stay at zero
+			world[tileIndex].LocalFieldValue = field;
+
+			float fieldStrength = field.Magnitude();
+			if (fieldStrength > largestField)
+				largestField = fieldStrength;
+		}
+	});
+}
+
+void TiledWorldGenerator::AggregateField()
+{
+	PROFILE_SCOPE("AggregateField");
 
-		// add the cell bounds
-		//drawList->AddRect(location, ImVec2(location.x + cellSize, location.y + cellSize), 0xFFFFFFFF);
+	// emitters are grouped by their own strength and range, so tiles that share them share a tree
+	aggregateTree.Build(world, worldLength, worldWidth);
 
-		// normalise the field
-		if (ShowField && largestFieldStrength > 0)
+	ForEachRowBlock([this](int firstRow, int endRow, float& largestField)
+	{
+		// the rows are split into square blocks, each of which shares a walk of the tree
+		std::vector<Vector2f> blockField;
+		for (int firstY = 0; firstY < worldWidth; firstY += FieldRowsPerTask)
 		{
-			Vector2f localField = tilePtr->LocalFieldValue.Normalised();// / largestFieldStrength;
-			workingColour = ImColor(0.5f + (localField.X / 2.0f), 
-									0.5f + (localField.Y / 2.0f), 
-									0.0f);
+			const int endY = std::min(firstY + FieldRowsPerTask, worldWidth);
+			aggregateTree.CalculateFieldBlock(firstRow, endRow, firstY, endY, OpeningAngle, blockField);
+
+			for (int x = firstRow; x < endRow; ++x)
+			{
+				for (int y = firstY; y < endY; ++y)
+				{
+					// obstacles never have a field
+					Tile& tile = world[(x * worldWidth) + y];
+					if (tile.Type == ettObstructed)
+						tile.LocalFieldValue = Vector2f::Zero;
+					else
+						tile.LocalFieldValue = blockField[((x - firstRow) * (endY - firstY)) + (y - firstY)];
+
+					float fieldStrength = tile.LocalFieldValue.Magnitude();
+					if (fieldStrength > largestField)
+						largestField = fieldStrength;
+				}
+			}
 		}
+	});
 
-		// draw the cell
-		drawList->AddRectFilled(ImVec2(location.x + CellBorder, location.y + CellBorder), 
-						        ImVec2(location.x + cellSize - CellBorder*2, location.y + cellSize - CellBorder*2),
-								workingColour);
+	approximationError = MeasureApproximationError ? CompareWithExactField() : -1;
+}
+
+float TiledWorldGenerator::CompareWithExactField()
+{
+	// scatter the exact field into a buffer of its own, leaving the tiles alone
+	const int maxReach = LookUpCellStencils();
+
+	scatterEmitters.clear();
+	for (int emitterIndex = 0; emitterIndex < (int)world.size(); ++emitterIndex)
+	{
+		if (cellStencils[emitterIndex])
+			scatterEmitters.push_back(emitterIndex);
+	}
+
+	exactFieldBuffer.assign(world.size(), Vector2f::Zero);
+	ForEachRowBlock([this, maxReach](int firstRow, int endRow, float&)
+	{
+		ScatterRows(firstRow, endRow, maxReach, exactFieldBuffer);
+	});
+
+	float largestExactField = 0;
+	float largestError = 0;
+	for (int tileIndex = 0; tileIndex < (int)world.size(); ++tileIndex)
+	{
+		const Vector2f& field = world[tileIndex].LocalFieldValue;
+		const Vector2f& exactField = exactFieldBuffer[tileIndex];
+
+		largestExactField = std::max(largestExactField, exactField.Magnitude());
+		largestError = std::max(largestError, std::max(std::fabs(field.X - exactField.X), std::fabs(field.Y - exactField.Y)));
+	}
+
+	return (largestExactField > 0) ? (largestError / largestExactField) : largestError;
+}
+
+void TiledWorldGenerator::SetFieldStrength(int paletteIndex, float fieldStrength)
+{
+	AvailableTile* entryPtr = TilePalette[paletteIndex];
+	const float oldStrength = entryPtr->FieldStrength;
+	const float oldRange = entryPtr->FieldRange;
+	entryPtr->FieldStrength = fieldStrength;
+
+	SyncPaletteEntry(paletteIndex, oldStrength, oldRange);
+
+	// re-weighting the layers is a single pass over the world (plus rebuilding any that edits have invalidated)
+	if (FieldCalculationMode == efmLayered && !worldCompact && fieldLayers.size() == TilePalette.size())
+	{
+		LayeredField();
+		RebuildFieldBlocks();
+	}
+}
+
+void TiledWorldGenerator::SetFieldRange(int paletteIndex, float fieldRange)
+{
+	AvailableTile* entryPtr = TilePalette[paletteIndex];
+	const float oldStrength = entryPtr->FieldStrength;
+	const float oldRange = entryPtr->FieldRange;
+	entryPtr->FieldRange = fieldRange;
+
+	SyncPaletteEntry(paletteIndex, oldStrength, oldRange);
+
+	// only the layer for this entry no longer matches its range, so it is the only one rebuilt
+	if (FieldCalculationMode == efmLayered && !worldCompact && fieldLayers.size() == TilePalette.size())
+	{
+		LayeredField();
+		RebuildFieldBlocks();
+	}
+}
+
+void TiledWorldGenerator::SyncPaletteEntry(int paletteIndex, float oldStrength, float oldRange)
+{
+	const AvailableTile& entry = *TilePalette[paletteIndex];
+
+	// the other modes read the strength and range from the tiles themselves, which only this entry's tiles change
+	for (Tile& tile : world)
+	{
+		if (tile.PaletteIndex != paletteIndex)
+			continue;
+
+		tile.FieldStrength = entry.FieldStrength;
+		tile.FieldRange = entry.FieldRange;
+		tile.UpdateBounds();
+	}
+
+	fieldValid = false;
+	emitterArraysDirty = true;
+
+	// the tree only holds emitters, by their reach, so a new strength alone leaves it as it is
+	const bool wasEmitting = (oldStrength != 0) && (oldRange > 0);
+	const bool isEmitting = (entry.FieldStrength != 0) && (entry.FieldRange > 0);
+	if (wasEmitting != isEmitting || (isEmitting && oldRange != entry.FieldRange))
+		treeDirty = true;
+
+	// only the stencils built for the old values have gone stale, along with the layers' unit stencil of the old range
+	if (wasEmitting)
+		InvalidateFieldStencils(oldStrength, oldRange);
+	if (oldRange != entry.FieldRange)
+		InvalidateFieldStencils(1.0f, oldRange);
+
+	// the chunks' fields only change if the entry emits, before or after
+	if (wasEmitting || isEmitting)
+		chunksReady = false;
+}
+
+int TiledWorldGenerator::LookUpCellStencils()
+{
+	const int maxRadius = std::max(worldLength, worldWidth) - 1;
+
+	// a compact world's cells all share their palette entry's stencil, so only the palette needs looking up
+	if (worldCompact)
+	{
+		std::vector<const FieldStencil*>().swap(cellStencils);
+		paletteStencils.assign(TilePalette.size(), nullptr);
+
+		int maxReach = 0;
+		for (size_t paletteIndex = 0; paletteIndex < TilePalette.size(); ++paletteIndex)
+		{
+			const AvailableTile* entryPtr = TilePalette[paletteIndex];
+			if (entryPtr->FieldStrength == 0 || entryPtr->FieldRange <= 0)
+				continue;
+
+			paletteStencils[paletteIndex] = &GetFieldStencil(entryPtr->FieldStrength, entryPtr->FieldRange);
+			maxReach = std::max(maxReach, paletteStencils[paletteIndex]->Radius);
+		}
+		return maxReach;
+	}
+
+	cellStencils.assign(world.size(), nullptr);
+
+	const FieldStencil* stencilPtr = nullptr;
+	int maxReach = 0;
+	for (int emitterIndex = 0; emitterIndex < (int)world.size(); ++emitterIndex)
+	{
+		const Tile& emitter = world[emitterIndex];
+		if (!emitter.EmitsField())
+			continue;
+
+		// neighbouring emitters are usually of the same type, so check the last stencil first
+		if (!stencilPtr || !stencilPtr->Matches(emitter.FieldStrength, emitter.FieldRange, maxRadius))
+			stencilPtr = &GetFieldStencil(emitter.FieldStrength, emitter.FieldRange);
+
+		cellStencils[emitterIndex] = stencilPtr;
+		maxReach = std::max(maxReach, stencilPtr->Radius);
+	}
+
+	return maxReach;
+}
+
+ThreadPool& TiledWorldGenerator::GetThreadPool()
+{
+	// (re)start the pool if the thread count has changed
+	const unsigned threadCount = (ThreadCount != 0) ? ThreadCount : std::max(1u, std::thread::hardware_concurrency());
+	if (!threadPool || threadPool->ThreadCount() != threadCount)
+	{
+		delete threadPool;
+		threadPool = new ThreadPool(threadCount);
+	}
+
+	return *threadPool;
+}
+
+void TiledWorldGenerator::ForEachRowBlock(const std::function<void(int, int, float&)>& rowTask)
+{
+	ThreadPool& pool = GetThreadPool();
+
+	// each thread tracks its own largest field, the maximum doesn't depend on the order they are combined in
+	std::vector<float> threadLargestField(pool.ThreadCount(), 0.0f);
+	const int taskCount = (worldLength + FieldRowsPerTask - 1) / FieldRowsPerTask;
+	pool.ParallelFor(taskCount, [this, &rowTask, &threadLargestField](int taskIndex, unsigned threadIndex)
+	{
+		const int firstRow = taskIndex * FieldRowsPerTask;
+		const int endRow = std::min(firstRow + FieldRowsPerTask, worldLength);
+
+		float largestField = 0;
+		rowTask(firstRow, endRow, largestField);
+
+		threadLargestField[threadIndex] = std::max(threadLargestField[threadIndex], largestField);
+	});
+
+	for (float largestField : threadLargestField)
+	{
+		largestFieldStrength = std::max(largestFieldStrength, largestField);
+	}
+}
+
+const FieldStencil& TiledWorldGenerator::GetFieldStencil(float fieldStrength, float fieldRange)
+{
+	// offsets larger than the world are never looked up
+	return GetFieldStencil(fieldStrength, fieldRange, std::max(worldLength, worldWidth) - 1);
+}
+
+const FieldStencil& TiledWorldGenerator::GetFieldStencil(float fieldStrength, float fieldRange, int maxRadius)
+{
+	for (FieldStencil* stencilPtr : fieldStencils)
+	{
+		if (stencilPtr->Matches(fieldStrength, fieldRange, maxRadius))
+			return *stencilPtr;
+	}
+
+	fieldStencils.push_back(new FieldStencil(fieldStrength, fieldRange, maxRadius));
+	return *fieldStencils.back();
+}
+
+void TiledWorldGenerator::InvalidateFieldStencils()
+{
+	for (FieldStencil* stencilPtr : fieldStencils)
+	{
+		delete stencilPtr;
+	}
+	fieldStencils.clear();
+
+	// the spectra are keyed by strength and range too, so they go at the same time, and so do the chunks
+	fieldConvolution.InvalidateSpectra();
+	chunkCache.Clear();
+	chunksReady = false;
+}
+
+void TiledWorldGenerator::InvalidateFieldStencils(float fieldStrength, float fieldRange)
+{
+	// the chunks keep pointers to their stencils, so they go too if any of theirs is deleted
+	for (const FieldStencil* stencilPtr : chunkStencils)
+	{
+		if (stencilPtr && stencilPtr->FieldStrength == fieldStrength && stencilPtr->FieldRange == fieldRange)
+			chunksReady = false;
+	}
+
+	fieldStencils.erase(std::remove_if(fieldStencils.begin(), fieldStencils.end(), [fieldStrength, fieldRange](FieldStencil* stencilPtr)
+	{
+		if (stencilPtr->FieldStrength != fieldStrength || stencilPtr->FieldRange != fieldRange)
+			return false;
+
+		delete stencilPtr;
+		return true;
+	}), fieldStencils.end());
+
+	fieldConvolution.InvalidateSpectra(fieldStrength, fieldRange);
+}
+
+void TiledWorldGenerator::ResetChunks(int capacity)
+{
+	if (capacity != chunkCache.Capacity())
+		chunkCache.SetCapacity(capacity);
+	else
+		chunkCache.Clear();
+
+	chunksReady = false;
+}
+
+const WorldChunk* TiledWorldGenerator::GetChunk(int chunkX, int chunkY)
+{
+	// a chunk's palette indices are bytes, and an empty palette has nothing to roll
+	if (TilePalette.empty() || TilePalette.size() > MaxCompactPaletteSize)
+		return nullptr;
+
+	// a new seed is a different world, and the palette may have changed since the last Generate
+	if (!chunksReady || chunkSeed != Seed)
+	{
+		chunkCache.Clear();
+		NormaliseProbabilities();
+
+		chunkSeed = Seed;
+		chunkReach = 0;
+		chunkStencils.assign(TilePalette.size(), nullptr);
+		for (size_t paletteIndex = 0; paletteIndex < TilePalette.size(); ++paletteIndex)
+		{
+			const AvailableTile* entryPtr = TilePalette[paletteIndex];
+			if (entryPtr->FieldStrength == 0 || entryPtr->FieldRange <= 0)
+				continue;
+
+			chunkStencils[paletteIndex] = &GetFieldStencil(entryPtr->FieldStrength, entryPtr->FieldRange, MaxChunkFieldReach);
+			chunkReach = std::max(chunkReach, chunkStencils[paletteIndex]->Radius);
+		}
+
+		chunksReady = true;
 	}
 
-	////////////////////////////////////////////////////////////////////////////////
-	// TODO: Add any debug drawing here. You can use drawList to draw lines etc
-	////////////////////////////////////////////////////////////////////////////////
+	if (WorldChunk* chunkPtr = chunkCache.Find(chunkX, chunkY))
+		return chunkPtr;
+
+	WorldChunk& chunk = chunkCache.Insert(chunkX, chunkY);
+	GenerateChunk(chunk);
+	return &chunk;
+}
+
+void TiledWorldGenerator::GenerateChunk(WorldChunk& chunk)
+{
+	PROFILE_SCOPE("GenerateChunk");
+
+	ThreadPool& pool = GetThreadPool();
+
+	// roll the chunk and the halo of cells around it that an emitter could reach it from, GetChunk has made sure
+	// every palette index fits in a byte
+	const int haloSide = ChunkSize + (2 * chunkReach);
+	const int haloX = (chunk.ChunkX * ChunkSize) - chunkReach;
+	const int haloY = (chunk.ChunkY * ChunkSize) - chunkReach;
+
+	chunkHalo.resize(haloSide * haloSide);
+	pool.ParallelFor(haloSide, [this, haloSide, haloX, haloY](int row, unsigned)
+	{
+		for (int column = 0; column < haloSide; ++column)
+		{
+			chunkHalo[(row * haloSide) + column] = (uint8_t)RollPaletteIndex(haloX + row, haloY + column);
+		}
+	});
+
+	chunk.Palette.resize(ChunkSize * ChunkSize);
+	for (int x = 0; x < ChunkSize; ++x)
+	{
+		std::copy_n(&chunkHalo[((x + chunkReach) * haloSide) + chunkReach], ChunkSize, &chunk.Palette[x * ChunkSize]);
+	}
+
+	// the halo is in world order, so stamping in halo order adds every cell's field up the same way as a scatter
+	chunkEmitters.clear();
+	for (int haloIndex = 0; haloIndex < haloSide * haloSide; ++haloIndex)
+	{
+		if (chunkStencils[chunkHalo[haloIndex]])
+			chunkEmitters.push_back(haloIndex);
+	}
+
+	chunk.Fields.assign(ChunkSize * ChunkSize, Vector2f::Zero);
+
+	// each block only stamps onto its own rows of the chunk
+	std::vector<float> threadLargestField(pool.ThreadCount(), 0.0f);
+	const int taskCount = (ChunkSize + FieldRowsPerTask - 1) / FieldRowsPerTask;
+	pool.ParallelFor(taskCount, [this, &chunk, &threadLargestField, haloSide](int taskIndex, unsigned threadIndex)
+	{
+		const int firstRow = taskIndex * FieldRowsPerTask;
+		const int endRow = std::min(firstRow + FieldRowsPerTask, ChunkSize);
+
+		// only the halo rows within reach of these rows can stamp onto them
+		auto firstEmitter = std::lower_bound(chunkEmitters.begin(), chunkEmitters.end(), firstRow * haloSide);
+		auto endEmitter = std::lower_bound(firstEmitter, chunkEmitters.end(), (endRow + (2 * chunkReach)) * haloSide);
+
+		for (auto emitterIt = firstEmitter; emitterIt != endEmitter; ++emitterIt)
+		{
+			const FieldStencil* stencilPtr = chunkStencils[chunkHalo[*emitterIt]];
+
+			// the emitter's position relative to the chunk's first cell
+			const int reach = stencilPtr->Radius;
+			const int emitterX = (*emitterIt / haloSide) - chunkReach;
+			const int emitterY = (*emitterIt % haloSide) - chunkReach;
+
+			const int minX = std::max(emitterX - reach, firstRow);
+			const int maxX = std::min(emitterX + reach, endRow - 1);
+			const int minY = std::max(emitterY - reach, 0);
+			const int maxY = std::min(emitterY + reach, ChunkSize - 1);
+
+			for (int x = minX; x <= maxX; ++x)
+			{
+				for (int y = minY; y <= maxY; ++y)
+				{
+					const int receiverIndex = (x * ChunkSize) + y;
+
+					// skip the emitter itself and obstacles, which never have a field
+					if ((x == emitterX && y == emitterY) || TilePalette[chunk.Palette[receiverIndex]]->Type == ettObstructed)
+						continue;
+
+					chunk.Fields[receiverIndex] += stencilPtr->At(x - emitterX, y - emitterY);
+				}
+			}
+		}
+
+		float largestField = 0;
+		for (int cellIndex = firstRow * ChunkSize; cellIndex < endRow * ChunkSize; ++cellIndex)
+		{
+			largestField = std::max(largestField, chunk.Fields[cellIndex].Magnitude());
+		}
+		threadLargestField[threadIndex] = std::max(threadLargestField[threadIndex], largestField);
+	});
+
+	for (float largestField : threadLargestField)
+	{
+		chunk.LargestFieldStrength = std::max(chunk.LargestFieldStrength, largestField);
+	}
+}
+
+ImU32 TiledWorldGenerator::GetCellColour(ImColor colour, const Vector2f& field, bool showField) const
+{
+	// normalise the field
+	if (showField)
+	{
+		Vector2f localField = field.Normalised();// / largestFieldStrength;
+		return ImColor(0.5f + (localField.X / 2.0f), 
+					   0.5f + (localField.Y / 2.0f), 
+					   0.0f);
+	}
+
+	return colour;
+}
+
+ImU32 TiledWorldGenerator::GetCellColour(int x, int y, bool showField) const
+{
+	const int cellIndex = (x * worldWidth) + y;
+	const ImColor& colour = worldCompact ? GetCellEntry(cellIndex).Colour : world[cellIndex].Colour;
+	return GetCellColour(colour, GetFieldAt(x, y), showField);
+}
+
+bool TiledWorldGenerator::UpdateWorldPixels(int& minX, int& maxX, int& minY, int& maxY)
+{
+	if ((int)worldPixels.size() != worldLength * worldWidth)
+	{
+		worldPixels.assign(worldLength * worldWidth, 0);
+		MarkPixelsDirty(0, worldLength - 1, 0, worldWidth - 1);
+	}
+
+	// showing or hiding the field repaints everything
+	const bool showField = ShowField && largestFieldStrength > 0;
+	TrackPaletteColours();
+	if (showField != pixelsShowField)
+	{
+		pixelsShowField = showField;
+		MarkPixelsDirty(0, worldLength - 1, 0, worldWidth - 1);
+	}
+
+	if (dirtyPixelsMinX > dirtyPixelsMaxX || dirtyPixelsMinY > dirtyPixelsMaxY)
+		return false;
+
+	for (int x = dirtyPixelsMinX; x <= dirtyPixelsMaxX; ++x)
+	{
+		for (int y = dirtyPixelsMinY; y <= dirtyPixelsMaxY; ++y)
+		{
+			worldPixels[(y * worldLength) + x] = GetCellColour(x, y, showField);
+		}
+	}
+
+	minX = dirtyPixelsMinX;
+	maxX = dirtyPixelsMaxX;
+	minY = dirtyPixelsMinY;
+	maxY = dirtyPixelsMaxY;
+
+	dirtyPixelsMinX = 0;
+	dirtyPixelsMaxX = -1;
+	dirtyPixelsMinY = 0;
+	dirtyPixelsMaxY = -1;
+	return true;
+}
+
+void TiledWorldGenerator::TrackPaletteColours()
+{
+	// a compact world's colours are looked up from the palette, which can be edited at any time
+	if (!worldCompact)
+		return;
+
+	bool recoloured = false;
+	trackedPaletteColours.resize(TilePalette.size(), 0);
+	for (int paletteIndex = 0; paletteIndex < (int)TilePalette.size(); ++paletteIndex)
+	{
+		const ImU32 colour = TilePalette[paletteIndex]->Colour;
+		recoloured |= (trackedPaletteColours[paletteIndex] != colour);
+		trackedPaletteColours[paletteIndex] = colour;
+	}
+
+	if (recoloured)
+	{
+		++worldGeneration;
+		MarkPixelsDirty(0, worldLength - 1, 0, worldWidth - 1);
+	}
+}
+
+void TiledWorldGenerator::MarkPixelsDirty(int minX, int maxX, int minY, int maxY)
+{
+	minX = std::max(minX, 0);
+	maxX = std::min(maxX, worldLength - 1);
+	minY = std::max(minY, 0);
+	maxY = std::min(maxY, worldWidth - 1);
+	if (minX > maxX || minY > maxY)
+		return;
+
+	// grow the dirty region to a rectangle covering both, it is uploaded as one
+	if (dirtyPixelsMinX > dirtyPixelsMaxX || dirtyPixelsMinY > dirtyPixelsMaxY)
+	{
+		dirtyPixelsMinX = minX;
+		dirtyPixelsMaxX = maxX;
+		dirtyPixelsMinY = minY;
+		dirtyPixelsMaxY = maxY;
+		return;
+	}
+
+	dirtyPixelsMinX = std::min(dirtyPixelsMinX, minX);
+	dirtyPixelsMaxX = std::max(dirtyPixelsMaxX, maxX);
+	dirtyPixelsMinY = std::min(dirtyPixelsMinY, minY);
+	dirtyPixelsMaxY = std::max(dirtyPixelsMaxY, maxY);
 }
 
 void TiledWorldGenerator::NormaliseProbabilities()
 {
+	PROFILE_SCOPE("NormaliseProbabilities");
+
 	// sum all of the tile frequencies
-	int frequencySum = 0;
+	int64_t frequencySum = 0;
 	for(AvailableTile* tilePtr : TilePalette)
 	{
-		frequencySum += tilePtr->Frequency;
+		frequencySum += std::max(tilePtr->Frequency, 0);
+	}
+
+	// build a Walker alias table (Vose's method): each column keeps its own entry with some probability and
+	// hands the rest to one alias, so sampling is one column roll and one compare whatever the palette size.
+	// Weights are scaled by the palette size so the average column is exactly frequencySum.
+	const int entryCount = (int)TilePalette.size();
+	aliasThresholds.assign(entryCount, UINT32_MAX);
+	aliasEntries.resize(entryCount);
+
+	std::vector<int64_t> scaledWeights(entryCount);
+	std::vector<int> smallColumns;
+	std::vector<int> largeColumns;
+	for (int paletteIndex = 0; paletteIndex < entryCount; ++paletteIndex)
+	{
+		aliasEntries[paletteIndex] = paletteIndex;
+
+		// with no frequencies at all every entry is equally likely
+		scaledWeights[paletteIndex] = (frequencySum > 0) ? (int64_t)std::max(TilePalette[paletteIndex]->Frequency, 0) * entryCount : 1;
+		if (scaledWeights[paletteIndex] < frequencySum)
+			smallColumns.push_back(paletteIndex);
+		else
+			largeColumns.push_back(paletteIndex);
 	}
 
-	// set the overall probability thresholds
-	float currentThreshold = 0;
-	for (AvailableTile* tilePtr : TilePalette)
+	while (!smallColumns.empty() && !largeColumns.empty())
 	{
-		currentThreshold += (float)tilePtr->Frequency / (float)frequencySum;
-		tilePtr->Threshold = currentThreshold;
+		const int smallColumn = smallColumns.back();
+		smallColumns.pop_back();
+		const int largeColumn = largeColumns.back();
+
+		// the small column keeps its share of the column and the large one fills the rest
+		aliasThresholds[smallColumn] = (uint32_t)(((double)scaledWeights[smallColumn] / (double)frequencySum) * 4294967296.0);
+		aliasEntries[smallColumn] = largeColumn;
+
+		scaledWeights[largeColumn] -= frequencySum - scaledWeights[smallColumn];
+		if (scaledWeights[largeColumn] < frequencySum)
+		{
+			largeColumns.pop_back();
+			smallColumns.push_back(largeColumn);
+		}
 	}
+
+	// whatever is left is full (up to rounding), so always keeps its own entry
 }
 
 void TiledWorldGenerator::ClearWorld()
 {
 	// cleanup the world
-	for (Tile* tilePtr : world)
-	{
-		delete tilePtr;
-	}
 	world.clear();
+	cellPalette.clear();
+	cellFields.clear();
+	worldLength = 0;
+	worldWidth = 0;
 }
 
 void TiledWorldGenerator::GenerateWorld()
 {
+	PROFILE_SCOPE("GenerateWorld");
+
+	// a palette index has to fit in a byte
+	worldCompact = CompactWorld && (TilePalette.size() <= MaxCompactPaletteSize);
+
 	// tile palette is empty so early out
 	if (TilePalette.size() == 0)
 		return;
 
-	// reserve space for the world
-	world.reserve(Length * Width);
+	// size the world up front, and hand back whatever the other representation was holding on to
+	if (worldCompact)
+	{
+		std::vector<Tile>().swap(world);
+		std::vector<Vector2f>().swap(fieldBuffer);
+		cellPalette.assign(Length * Width, 0);
+		cellFields.assign(Length * Width, Vector2f::Zero);
+	}
+	else
+	{
+		std::vector<uint8_t>().swap(cellPalette);
+		std::vector<Vector2f>().swap(cellFields);
+		world.assign(Length * Width, Tile(ettFree, ImColor(), Vector2f::Zero, 0, 0));
+	}
+	worldLength = Length;
+	worldWidth = Width;
+
+	// every cell's roll only depends on the seed and where it is, so the rows can be generated on any thread
+	ForEachRowBlock([this](int firstRow, int endRow, float&)
+	{
+		GenerateRows(firstRow, endRow);
+	});
+}
+
+void TiledWorldGenerator::GenerateRows(int firstRow, int endRow)
+{
+	PROFILE_SCOPE("GenerateRows");
 
-	// generate the world
-	for (int lengthIndex = 0; lengthIndex < Length; ++lengthIndex)
+	for (int lengthIndex = firstRow; lengthIndex < endRow; ++lengthIndex)
 	{
-		for (int widthIndex = 0; widthIndex < Width; ++widthIndex)
+		for (int widthIndex = 0; widthIndex < worldWidth; ++widthIndex)
 		{
-			// roll a random number from 0 to 1
-			float roll = (float)(rand() % 101) / 100.0f;
+			const int cellIndex = (lengthIndex * worldWidth) + widthIndex;
+			const int referenceIndex = RollPaletteIndex(lengthIndex, widthIndex);
 
-			// select matching reference tile (default is pure random)
-			AvailableTile* referenceTilePtr = nullptr;
-			for(AvailableTile* tilePtr : TilePalette)
+			// a compact world only records which entry it is
+			if (worldCompact)
 			{
-				if (roll <= tilePtr->Threshold)
-				{
-					referenceTilePtr = tilePtr;
-					break;
-				}
+				cellPalette[cellIndex] = (uint8_t)referenceIndex;
+				continue;
 			}
-			if (!referenceTilePtr)
-				referenceTilePtr = TilePalette[rand() % TilePalette.size()];
-			 
+
 			// instantiate the new tile
-			world.push_back(new Tile(referenceTilePtr->Type, referenceTilePtr->Colour, 
-									 Vector2f((float)lengthIndex, (float)widthIndex), 
-									 referenceTilePtr->FieldStrength, referenceTilePtr->FieldRange));
+			const AvailableTile* referenceTilePtr = TilePalette[referenceIndex];
+			world[cellIndex] = Tile(referenceTilePtr->Type, referenceTilePtr->Colour, 
+									Vector2f((float)lengthIndex, (float)widthIndex), 
+									referenceTilePtr->FieldStrength, referenceTilePtr->FieldRange);
+			world[cellIndex].PaletteIndex = referenceIndex;
 		}
 	}
-
-	
 }
 
-std::vector<Tile*> TiledWorldGenerator::ReturnSelectedNode(Vector2f _target)
+int TiledWorldGenerator::RollPaletteIndex(int x, int y) const
 {
-	return rootNode->FindTiles(_target);
+	// the random words for a cell are keyed by the seed and counted by its coordinates
+	uint32_t random[4];
+	CounterRandom::Generate(Seed, (uint32_t)x, (uint32_t)y, GenerationStream, 0, random);
+
+	// pick a column of the alias table with one word (scaled by a multiply rather than a biased modulo), then
+	// whether to keep it or take its alias with the other, both at the full 32 bits
+	const uint32_t column = (uint32_t)(((uint64_t)random[0] * aliasThresholds.size()) >> 32);
+	return (random[1] < aliasThresholds[column]) ? (int)column : aliasEntries[column];
 }
 
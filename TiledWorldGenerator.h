@@ -2,15 +2,32 @@
 
 #include <vector>
 #include <string>
+#include <functional>
+#include <cstdint>
 #include "imgui.h"
 #include "Tile.h"
-#include "Node.h"
+#include "QuadTree.h"
+#include "LinearQuadTree.h"
+#include "FieldStencil.h"
+#include "FieldKernel.h"
+#include "ThreadPool.h"
+#include "FieldConvolution.h"
+#include "FieldAggregateTree.h"
+#include "ChunkCache.h"
+
+enum FieldMode
+{
+    efmGather,
+    efmScatter,
+    efmConvolution,
+    efmLayered,
+    efmAggregate
+};
 
 class AvailableTile
 {
     public:
         int Frequency;
-        float Threshold;
         std::string Name;
         ImColor Colour;
         TileType Type;
@@ -25,13 +42,22 @@ class AvailableTile
         }
 };
 
+/**
+ * The field of every tile of one palette entry, as if its strength was 1.
+ */
+struct FieldLayer
+{
+    float FieldRange = 0;
+    bool Dirty = true;
+    std::vector<Vector2f> Values;
+};
+
 class TiledWorldGenerator
 {
     public:
         int Length;
         int Width;
         std::vector<AvailableTile*> TilePalette;
-		Node *rootNode;
 
         TiledWorldGenerator() :
             Length(120), Width(120)
@@ -51,26 +77,367 @@ class TiledWorldGenerator
             }
             TilePalette.clear();
 
+            InvalidateFieldStencils();
             ClearWorld();
+
+            delete threadPool;
         }
 
         void Generate();
 
+        void BuildTree();
+
+        /**
+         * Changes the type of a single tile in place. The tree is patched rather than rebuilt, unless
+         * the bulk loaded tree is in use, in which case it is rebuilt on the next CalculateField.
+         *
+         * If the field is up to date it is patched too: the tile's old emission is subtracted and its new one
+         * added, only within their ranges, and the tile's own field is gathered again. The largest field strength
+         * is kept up to date from per block maxima, so the world is never rescanned. Patching rounds differently
+         * to a full CalculateField, so long runs of edits drift by a few ulps per edit. A convolved field is patched
+         * exactly too, so it stays within FieldConvolution::Tolerance of the exact field, but an approximate
+         * (efmAggregate) one is invalidated instead, as there is no exact contribution in it to take away.
+         *
+         * @param x The x (length) coordinate of the tile.
+         * @param y The y (width) coordinate of the tile.
+         * @param tileType The palette entry to change the tile to. Anything that isn't one of the entries is ignored.
+         */
+        void SetTileType(int x, int y, const AvailableTile& tileType);
+
         void CalculateField();
 
-        void DrawWorld();
+        /**
+         * Changes the strength of a palette entry and of every tile of that entry. In layered mode the field is
+         * updated straight away by re-weighting the layers, without recalculating any of them.
+         *
+         * @param paletteIndex The palette entry to change.
+         * @param fieldStrength The new strength.
+         */
+        void SetFieldStrength(int paletteIndex, float fieldStrength);
+
+        /**
+         * Changes the range of a palette entry and of every tile of that entry. In layered mode the field is
+         * updated straight away, recalculating only this entry's layer.
+         *
+         * @param paletteIndex The palette entry to change.
+         * @param fieldRange The new range.
+         */
+        void SetFieldRange(int paletteIndex, float fieldRange);
+
+        /**
+         * Throws away the cached field stencils, and the cached chunks whose fields were built from them. Call this
+         * when the strength or range of a palette entry changes.
+         */
+        void InvalidateFieldStencils();
+
+        /**
+         * Throws away the cached field stencils (and kernel spectra) of one strength and range, leaving the rest.
+         *
+         * @param fieldStrength The strength of the stencils to throw away.
+         * @param fieldRange The range of the stencils to throw away.
+         */
+        void InvalidateFieldStencils(float fieldStrength, float fieldRange);
+
+        /**
+         * Gets a chunk of the unbounded world that the seed describes, generating it if it is not cached. Cells are
+         * rolled exactly as GenerateWorld rolls them, so a chunk matches a generated world wherever that world's
+         * edges are out of range. The field takes in every emitter within range (up to MaxChunkFieldReach cells),
+         * whichever chunk it is in. Only the most recently used chunks are kept, up to the capacity given to
+         * ResetChunks. Like a compact world, the palette can have at most MaxCompactPaletteSize entries.
+         *
+         * @param chunkX The x (length) coordinate of the chunk, in chunks.
+         * @param chunkY The y (width) coordinate of the chunk, in chunks.
+         *
+         * @return The chunk, valid until the next GetChunk, or nullptr if the palette is empty or has more than
+         *         MaxCompactPaletteSize entries.
+         */
+        const WorldChunk* GetChunk(int chunkX, int chunkY);
+
+        /**
+         * Forgets every cached chunk and changes how many are kept. Call this when the palette's frequencies change,
+         * Generate and a change of seed do it anyway.
+         *
+         * @param capacity The most chunks to keep.
+         */
+        void ResetChunks(int capacity = ChunkCache::DefaultCapacity);
+
+        int GetCachedChunkCount() const { return chunkCache.Size(); }
+        int GetChunkCapacity() const { return chunkCache.Capacity(); }
+
+        /**
+         * Brings the world's pixels up to date, repainting only the cells that changed since the last call: all of
+         * them after Generate, CalculateField or toggling ShowField, and only the cells a patched field reached
+         * after SetTileType.
+         *
+         * @param minX Receives the lowest x of the cells that changed.
+         * @param maxX Receives the highest x of the cells that changed.
+         * @param minY Receives the lowest y of the cells that changed.
+         * @param maxY Receives the highest y of the cells that changed.
+         *
+         * @return False if no cell changed, in which case the region is left alone.
+         */
+        bool UpdateWorldPixels(int& minX, int& maxX, int& minY, int& maxY);
+
+        /**
+         * Gets the colour of every cell as an RGBA pixel (the tile's colour, or its field if ShowField is set), laid
+         * out as y * length + x so the world maps straight onto a texture of length by width pixels.
+         */
+        const std::vector<ImU32>& GetWorldPixels() const { return worldPixels; }
+
+        /** Whether cells are coloured by their field, which needs ShowField set and a field to show. */
+        bool IsFieldShown() const { return ShowField && largestFieldStrength > 0; }
+
+        /**
+         * Gets the colour a cell is drawn in, the tile's colour or, if showField is set, its field's direction.
+         *
+         * @param x The x (length) coordinate of the cell.
+         * @param y The y (width) coordinate of the cell.
+         * @param showField Whether to colour the cell by its field.
+         */
+        ImU32 GetCellColour(int x, int y, bool showField) const;
+        ImU32 GetCellColour(ImColor colour, const Vector2f& field, bool showField) const;
+
+        /**
+         * A compact world's colours are looked up from the palette, which can be edited at any time, so anything
+         * drawn from the world calls this first: it counts a change of a palette colour as a change to the world.
+         */
+        void TrackPaletteColours();
+
+        /** Gets the threads the field passes run on, for anything else that works on the world in row blocks. */
+        ThreadPool& GetThreadPool();
+
+        /** Counts the changes to the world's tiles, so anything derived from them can tell when it is stale. */
+        unsigned GetWorldGeneration() const { return worldGeneration; }
+
+        /** Counts the changes to the world's field. */
+        unsigned GetFieldGeneration() const { return fieldGeneration; }
+
+        int GetWorldLength() const { return worldLength; }
+        int GetWorldWidth() const { return worldWidth; }
+
+		/**
+		 * Calls the visitor for every field emitting tile in the tree node that covers the target location, in
+		 * whichever tree was last built. A compact world has no tree, and a tree that is out of date with the world
+		 * (until the next BuildTree, which gathering the field does) is not searched, so neither visits anything.
+		 *
+		 * @param target The location to search for.
+		 * @param visitor Callable taking a const Tile&.
+		 */
+		template <typename Visitor>
+		void VisitSelectedNode(const Vector2f& target, Visitor&& visitor) const;
 
-		std::vector<Tile*> ReturnSelectedNode(Vector2f);
+		/**
+		 * Calls the visitor with the bounds of every node of the pooled tree that overlaps the bounds. The compact world
+		 * and the bulk loaded tree have no nodes to visit, and neither does a tree that is out of date with the world.
+		 *
+		 * @param bounds The cells to visit the nodes over.
+		 * @param visitor Callable taking a const AABBf&.
+		 */
+		template <typename Visitor>
+		void VisitTreeNodes(const AABBf& bounds, Visitor&& visitor) const;
+
+		/**
+		 * Gets the tiles, laid out as x * Width + y. A tile's index is also its handle in the trees.
+		 * A compact world has no tiles, so this is empty.
+		 */
+		const std::vector<Tile>& GetWorld() const { return world; }
+
+		bool IsWorldCompact() const { return worldCompact; }
+
+		/**
+		 * Gets the palette entry a compact world's cell was generated (or later set) as.
+		 *
+		 * @param x The x (length) coordinate of the cell.
+		 * @param y The y (width) coordinate of the cell.
+		 *
+		 * @return The index into TilePalette.
+		 */
+		int GetCellPaletteIndex(int x, int y) const { return cellPalette[(x * worldWidth) + y]; }
+
+		/**
+		 * Gets the field of a cell, whichever way the world is stored.
+		 *
+		 * @param x The x (length) coordinate of the cell.
+		 * @param y The y (width) coordinate of the cell.
+		 *
+		 * @return The field of the cell.
+		 */
+		const Vector2f& GetFieldAt(int x, int y) const
+		{
+			const int cellIndex = (x * worldWidth) + y;
+			return worldCompact ? cellFields[cellIndex] : world[cellIndex].LocalFieldValue;
+		}
+
+		float GetLargestFieldStrength() const { return largestFieldStrength; }
+
+		/**
+		 * Gets the error of the last approximate (efmAggregate) field, if MeasureApproximationError was set.
+		 *
+		 * @return The largest difference in either component from the exact field, relative to the largest exact
+		 *         field strength, or -1 if it was not measured or an edit has invalidated the field since.
+		 */
+		float GetApproximationError() const { return approximationError; }
+
+		/**
+		 * Gets the number of nodes, emitters included, in the trees of the last approximate (efmAggregate) field.
+		 */
+		size_t GetAggregateNodeCount() const { return aggregateTree.GetNodeCount(); }
 
     protected:
 	    void NormaliseProbabilities();
 	    void ClearWorld();
 	    void GenerateWorld();
+	    void GenerateRows(int firstRow, int endRow);
+	    int RollPaletteIndex(int x, int y) const;
+	    void GatherField();
+	    void GatherRows(int firstRow, int endRow, KernelIsa kernelIsa, float& largestField);
+	    void PackEmitterArrays();
+	    void ScatterField();
+	    void ScatterRows(int firstRow, int endRow, int maxReach, std::vector<Vector2f>& buffer);
+	    void CopyFieldOut(int firstRow, int endRow, float& largestField);
+	    void ConvolveField();
+	    void LayeredField();
+	    void BuildFieldLayer(int paletteIndex);
+	    void ComposeFieldLayers();
+	    void SyncPaletteEntry(int paletteIndex, float oldStrength, float oldRange);
+	    int FindPaletteIndex(const AvailableTile& tileType) const;
+	    void AggregateField();
+	    float CompareWithExactField();
+	    void SetCompactTileType(int x, int y, const AvailableTile& tileType);
+	    void GenerateChunk(WorldChunk& chunk);
+	    void PatchField(int x, int y, bool wasEmitter, float oldStrength, float oldRange);
+	    void StampTileField(int x, int y, float fieldStrength, float fieldRange);
+	    void RebuildFieldBlocks();
+	    void UpdateFieldBlocks(int minX, int maxX, int minY, int maxY);
+	    int LookUpCellStencils();
+	    void ForEachRowBlock(const std::function<void(int, int, float&)>& rowTask);
+	    const FieldStencil& GetFieldStencil(float fieldStrength, float fieldRange);
+	    const FieldStencil& GetFieldStencil(float fieldStrength, float fieldRange, int maxRadius);
+	    void MarkPixelsDirty(int minX, int maxX, int minY, int maxY);
+
+	    // per cell lookups that work on either world representation
+	    const AvailableTile& GetCellEntry(int cellIndex) const { return *TilePalette[cellPalette[cellIndex]]; }
+	    TileType GetCellType(int cellIndex) const { return worldCompact ? GetCellEntry(cellIndex).Type : world[cellIndex].Type; }
+	    float GetCellFieldStrength(int cellIndex) const { return worldCompact ? GetCellEntry(cellIndex).FieldStrength : world[cellIndex].FieldStrength; }
+	    float GetCellFieldRange(int cellIndex) const { return worldCompact ? GetCellEntry(cellIndex).FieldRange : world[cellIndex].FieldRange; }
+	    bool CellEmitsField(int cellIndex) const { return (GetCellFieldStrength(cellIndex) != 0) && (GetCellFieldRange(cellIndex) > 0); }
+	    Vector2f& GetCellField(int cellIndex) { return worldCompact ? cellFields[cellIndex] : world[cellIndex].LocalFieldValue; }
+	    const FieldStencil* GetCellStencil(int cellIndex) const { return worldCompact ? paletteStencils[cellPalette[cellIndex]] : cellStencils[cellIndex]; }
 
     protected:
-        std::vector<Tile*> world;
-        float largestFieldStrength;
+        std::vector<Tile> world;
+        int worldLength = 0;
+        int worldWidth = 0;
+        bool worldCompact = false;
+        std::vector<uint8_t> cellPalette;
+        std::vector<Vector2f> cellFields;
+        std::vector<const FieldStencil*> paletteStencils;
+        std::vector<uint32_t> aliasThresholds;
+        std::vector<int> aliasEntries;
+        ChunkCache chunkCache;
+        bool chunksReady = false;
+        uint64_t chunkSeed = 0;
+        int chunkReach = 0;
+        std::vector<const FieldStencil*> chunkStencils;
+        std::vector<uint8_t> chunkHalo;
+        std::vector<int> chunkEmitters;
+        std::vector<int> emitters;
+        std::vector<Vector2f> fieldBuffer;
+        std::vector<FieldStencil*> fieldStencils;
+        std::vector<const FieldStencil*> cellStencils;
+        std::vector<int> scatterEmitters;
+        FieldConvolution fieldConvolution;
+        std::vector<FieldLayer> fieldLayers;
+        FieldAggregateTree aggregateTree;
+        std::vector<Vector2f> exactFieldBuffer;
+        float approximationError = -1;
+        FieldMode fieldMode = efmGather;
+        std::vector<float> blockLargestField;
+        int fieldBlockRows = 0;
+        int fieldBlockColumns = 0;
+        bool fieldValid = false;
+        ThreadPool* threadPool = nullptr;
+        QuadTree tree;
+        LinearQuadTree linearTree;
+        EmitterArrays emitterArrays;
+        std::vector<int> leafEmitterStart;
+        std::vector<int> leafEmitterEnd;
+        bool emitterArraysDirty = true;
+        bool treeDirty = true;
+        bool treeBulkLoaded = false;
+        float largestFieldStrength = 0;
+        std::vector<ImU32> worldPixels;
+        std::vector<ImU32> trackedPaletteColours;
+        bool pixelsShowField = false;
+        int dirtyPixelsMinX = 0;
+        int dirtyPixelsMaxX = -1;
+        int dirtyPixelsMinY = 0;
+        int dirtyPixelsMaxY = -1;
+        unsigned worldGeneration = 0;
+        unsigned fieldGeneration = 0;
 
     public:
         bool ShowField = false;
+        bool BulkLoadTree = false;
+
+        /**
+         * Generate the next world as just a palette index and a field per cell, around 9 bytes a cell rather than
+         * a whole Tile. The type, strength, range and colour of a cell are looked up from the palette, so it is only
+         * used while the palette has at most MaxCompactPaletteSize entries. A compact world has no trees and no room for per cell
+         * stencils or transforms, so its field is always scattered, whatever the field mode.
+         */
+        bool CompactWorld = false;
+        static const int MaxCompactPaletteSize = 256;
+
+        /** Every cell's type is a function of the seed and its coordinates, so a seed gives the same world on any number of threads. */
+        uint64_t Seed = 1;
+
+        /** The counter word that keeps the generation rolls apart from any other use of the seed. */
+        static const uint32_t GenerationStream = 0;
+
+        /** The number of cells along each side of a chunk. */
+        static const int ChunkSize = 64;
+
+        /** Emitters further than this many cells from a chunk are left out of its field. */
+        static const int MaxChunkFieldReach = 1024;
+
+        unsigned ThreadCount = 0;
+        FieldMode FieldCalculationMode = efmGather;
+        KernelIsa GatherKernel = ekiAVX2;
+
+        /**
+         * In efmAggregate mode, groups of emitters smaller than this times their distance are approximated. 0 gives the
+         * exact field, and the error grows quickly past 1.
+         */
+        float OpeningAngle = 0.5f;
+        bool MeasureApproximationError = false;
+
+        /** The field is calculated in blocks of this many rows, which are shared out between the threads. */
+        static const int FieldRowsPerTask = 8;
+
+        /** The largest field strength is tracked per square block of this many tiles a side, for patching. */
+        static const int FieldBlockSize = 16;
 };
+
+template <typename Visitor>
+void TiledWorldGenerator::VisitSelectedNode(const Vector2f& target, Visitor&& visitor) const
+{
+	if (worldCompact || treeDirty)
+		return;
+
+	auto visitTile = [this, &visitor](int handle) { visitor(world[handle]); };
+
+	if (treeBulkLoaded)
+		linearTree.VisitTiles(target, visitTile);
+	else
+		tree.VisitTiles(target, visitTile);
+}
+
+template <typename Visitor>
+void TiledWorldGenerator::VisitTreeNodes(const AABBf& bounds, Visitor&& visitor) const
+{
+	if (worldCompact || treeDirty || treeBulkLoaded)
+		return;
+
+	tree.VisitNodes(bounds, [&visitor](int, const QuadNode& node) { visitor(node.boundingBox); });
+}
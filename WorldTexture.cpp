@@ -0,0 +1,81 @@
+#include "WorldTexture.h"
+#include "TiledWorldGenerator.h"
+#include "WorldView.h"
+#include <GLFW/glfw3.h>
+
+void WorldTexture::Update(TiledWorldGenerator& worldGen, const WorldView& view)
+{
+	const int level = view.GetDrawnMipLevel();
+	if (level > 0)
+	{
+		// a level is at most about the window's size, so it is uploaded whole whenever it changes
+		if (level != textureLevel || view.GetMipGeneration() != textureMipGeneration)
+			Upload(view.GetWorldMip(level), view.GetWorldMipLength(level), view.GetWorldMipWidth(level));
+
+		textureLevel = level;
+		textureMipGeneration = view.GetMipGeneration();
+		return;
+	}
+
+	int minX, maxX, minY, maxY;
+	const bool changed = worldGen.UpdateWorldPixels(minX, maxX, minY, maxY);
+
+	const int length = worldGen.GetWorldLength();
+	const int width = worldGen.GetWorldWidth();
+	const std::vector<ImU32>& pixels = worldGen.GetWorldPixels();
+	if (length == 0 || width == 0)
+		return;
+
+	if (textureLevel != 0 || length != textureLength || width != textureWidth)
+	{
+		Upload(pixels, length, width);
+		textureLevel = 0;
+		return;
+	}
+
+	if (!changed)
+		return;
+
+	GLint lastTexture;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &lastTexture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	// the changed rectangle is read straight out of the full pixel rows
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, length);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, minX, minY, (maxX - minX) + 1, (maxY - minY) + 1, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[(minY * length) + minX]);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	glBindTexture(GL_TEXTURE_2D, lastTexture);
+}
+
+void WorldTexture::Upload(const std::vector<ImU32>& pixels, int length, int width)
+{
+	GLint lastTexture;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &lastTexture);
+
+	if (texture == 0)
+		glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	// new storage, filled in full; nearest filtering keeps the cells' edges sharp however far they are stretched
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, length, width, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+	textureLength = length;
+	textureWidth = width;
+
+	glBindTexture(GL_TEXTURE_2D, lastTexture);
+}
+
+void WorldTexture::Release()
+{
+	if (texture == 0)
+		return;
+
+	glDeleteTextures(1, &texture);
+	texture = 0;
+	textureLength = 0;
+	textureWidth = 0;
+	textureLevel = 0;
+}
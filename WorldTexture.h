@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "imgui.h"
+
+class TiledWorldGenerator;
+class WorldView;
+
+/**
+ * OpenGL texture holding a pixel per cell of a generated world, for WorldView::DrawWorld to draw as a
+ * single quad. Only the cells that changed since the last update are uploaded, or, when the world is drawn from its mip
+ * pyramid, the drawn level.
+ */
+class WorldTexture
+{
+public:
+	/**
+	 * Brings the texture up to date with the world, reallocating it if the world's size changed and otherwise
+	 * uploading only the rectangle of cells that changed. If the view's last DrawWorld drew a level of the mip
+	 * pyramid, the texture holds that level instead. Call this after DrawWorld, before rendering.
+	 *
+	 * @param worldGen The generator whose pixels to upload.
+	 * @param view The view that draws the texture, whose mip pyramid to upload from.
+	 */
+	void Update(TiledWorldGenerator& worldGen, const WorldView& view);
+
+	/**
+	 * Deletes the texture. Call this while the GL context is still current.
+	 */
+	void Release();
+
+	ImTextureID GetTextureId() const { return (void*)(intptr_t)texture; }
+
+protected:
+	void Upload(const std::vector<ImU32>& pixels, int length, int width);
+
+protected:
+	// a GLuint, kept as unsigned int so the header doesn't need GL
+	unsigned int texture = 0;
+	int textureLength = 0;
+	int textureWidth = 0;
+	int textureLevel = 0;
+	unsigned textureMipGeneration = 0;
+};
@@ -0,0 +1,439 @@
+#include "WorldView.h"
+#include "TiledWorldGenerator.h"
+#include "imgui_internal.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <chrono>
+
+const float WindowBuffer = 5.0f;
+const float CellBorder = 1.0f;
+const ImU32 NodeOutlineColour = IM_COL32(255, 255, 255, 160);
+
+const float WorldView::CameraZoomStep = 1.25f;
+const float WorldView::MinCameraZoom = 1.0f / 64.0f;
+const float WorldView::MaxCameraZoom = 64.0f;
+
+void WorldView::DrawWorld(TiledWorldGenerator& worldGen, ImTextureID worldTexture)
+{
+	PROFILE_SCOPE("DrawWorld");
+
+	using namespace std::chrono;
+
+	const int worldLength = worldGen.GetWorldLength();
+	const int worldWidth = worldGen.GetWorldWidth();
+
+	// early out if there is no world
+	if ((worldLength == 0 || worldWidth == 0) && !ShowChunks)
+	{
+		drawTime = 0;
+		drawnCellCount = 0;
+		return;
+	}
+
+	high_resolution_clock::time_point startTime = high_resolution_clock::now();
+
+	// grab the window
+	ImGuiWindow* window = ImGui::GetCurrentWindowRead();
+
+	// determine the cell size, fitting Length x Width cells to the window before zooming
+	ImVec2 windowSize = ImGui::GetWindowSize();
+	const ImVec2 viewSize(windowSize.x - (WindowBuffer * 2), windowSize.y - window->TitleBarHeight() - (WindowBuffer * 2));
+	const float fitScale = std::min(viewSize.x / worldGen.Length, viewSize.y / worldGen.Width);
+
+	// get the draw list to update
+	ImDrawList* drawList = ImGui::GetWindowDrawList();
+
+	// get the window pos
+	ImVec2 viewStart = ImGui::GetWindowPos();
+	viewStart.x += WindowBuffer;
+	viewStart.y += window->TitleBarHeight() + WindowBuffer;
+
+	// chunks have a view of their own
+	if (ShowChunks)
+	{
+		int viewLength, viewWidth;
+		ClampChunkView(worldGen, viewSize, viewLength, viewWidth);
+
+		drawnMipLevel = 0;
+		drawnCellCount = viewLength * viewWidth;
+		DrawChunks(worldGen, drawList, viewStart, (int)std::min(viewSize.x / viewLength, viewSize.y / viewWidth), viewLength, viewWidth);
+		drawTime = duration<float, std::micro>(high_resolution_clock::now() - startTime).count();
+		return;
+	}
+
+	UpdateCamera(viewStart, fitScale);
+	const float cellScale = GetViewScale(fitScale);
+	int cellSize = (int) cellScale;
+
+	// cells are drawn relative to the camera, and only those the window shows
+	const ImVec2 startPoint(viewStart.x - (CameraX * cellScale), viewStart.y - (CameraY * cellScale));
+	const AABBf visibleBounds(Vector2f(std::max(std::floor(CameraX), 0.0f), std::max(std::floor(CameraY), 0.0f)),
+							  Vector2f(std::min(std::ceil(CameraX + (viewSize.x / cellScale)), (float)worldLength),
+									   std::min(std::ceil(CameraY + (viewSize.y / cellScale)), (float)worldWidth)));
+	const int visibleCells = (int)(std::max(visibleBounds.boxMax.X - visibleBounds.boxMin.X, 0.0f) * std::max(visibleBounds.boxMax.Y - visibleBounds.boxMin.Y, 0.0f));
+
+	// draw the tiles
+	const bool showField = worldGen.IsFieldShown();
+	drawnMipLevel = 0;
+	drawnCellCount = visibleCells;
+	if (cellScale < MinCellPixels || (DrawAsTexture && worldTexture) || visibleCells > MaxMipRects)
+	{
+		DrawWorldMips(worldGen, drawList, startPoint, cellScale, visibleBounds, worldTexture, showField);
+	}
+	else if (CacheDraw)
+	{
+		// rebuild the rectangles only if anything they were built from has changed
+		worldGen.TrackPaletteColours();
+		if (!drawCacheValid || drawnWorldGeneration != worldGen.GetWorldGeneration() || drawnFieldGeneration != worldGen.GetFieldGeneration() ||
+			drawnStartPoint.x != startPoint.x || drawnStartPoint.y != startPoint.y || drawnCellSize != cellSize || drawnShowField != showField ||
+			drawnVisibleBounds != visibleBounds)
+		{
+			cellDrawList.Clear();
+			cellDrawList.AddDrawCmd();
+			DrawCells(worldGen, &cellDrawList, startPoint, cellSize, visibleBounds, showField);
+
+			drawCacheValid = true;
+			drawnWorldGeneration = worldGen.GetWorldGeneration();
+			drawnFieldGeneration = worldGen.GetFieldGeneration();
+			drawnStartPoint = startPoint;
+			drawnCellSize = cellSize;
+			drawnShowField = showField;
+			drawnVisibleBounds = visibleBounds;
+		}
+
+		AppendDrawCache(drawList);
+	}
+	else
+	{
+		DrawCells(worldGen, drawList, startPoint, cellSize, visibleBounds, showField);
+	}
+
+	// outline the tree's nodes that are in view
+	if (ShowTreeNodes)
+	{
+		worldGen.VisitTreeNodes(visibleBounds, [drawList, &startPoint, cellScale](const AABBf& nodeBounds)
+		{
+			drawList->AddRect(ImVec2(startPoint.x + (nodeBounds.boxMin.X * cellScale), startPoint.y + (nodeBounds.boxMin.Y * cellScale)),
+							  ImVec2(startPoint.x + (nodeBounds.boxMax.X * cellScale), startPoint.y + (nodeBounds.boxMax.Y * cellScale)),
+							  NodeOutlineColour);
+		});
+	}
+
+	drawTime = duration<float, std::micro>(high_resolution_clock::now() - startTime).count();
+}
+
+void WorldView::ResetCamera()
+{
+	CameraX = 0;
+	CameraY = 0;
+	CameraZoom = 1;
+}
+
+float WorldView::GetViewScale(float fitScale) const
+{
+	// cells big enough to draw individually are drawn a whole number of pixels across
+	const float cellScale = fitScale * CameraZoom;
+	return (cellScale < MinCellPixels) ? cellScale : std::floor(cellScale);
+}
+
+void WorldView::UpdateCamera(const ImVec2& viewStart, float fitScale)
+{
+	if (!ImGui::IsWindowHovered())
+		return;
+
+	const ImGuiIO& io = ImGui::GetIO();
+
+	// zoom about the mouse, keeping the point under it where it is
+	if (io.MouseWheel != 0)
+	{
+		const float oldScale = GetViewScale(fitScale);
+		const float mouseX = CameraX + ((io.MousePos.x - viewStart.x) / oldScale);
+		const float mouseY = CameraY + ((io.MousePos.y - viewStart.y) / oldScale);
+
+		CameraZoom = std::min(std::max(CameraZoom * std::pow(CameraZoomStep, io.MouseWheel), MinCameraZoom), MaxCameraZoom);
+
+		const float newScale = GetViewScale(fitScale);
+		CameraX = mouseX - ((io.MousePos.x - viewStart.x) / newScale);
+		CameraY = mouseY - ((io.MousePos.y - viewStart.y) / newScale);
+	}
+
+	// drag the world around with the left button
+	if (ImGui::IsMouseDragging(0))
+	{
+		const float scale = GetViewScale(fitScale);
+		CameraX -= io.MouseDelta.x / scale;
+		CameraY -= io.MouseDelta.y / scale;
+	}
+}
+
+void WorldView::DrawWorldMips(TiledWorldGenerator& worldGen, ImDrawList* drawList, const ImVec2& startPoint, float cellScale, const AABBf& visibleBounds,
+	ImTextureID worldTexture, bool showField)
+{
+	const int firstX = (int)visibleBounds.boxMin.X;
+	const int endX = (int)visibleBounds.boxMax.X;
+	const int firstY = (int)visibleBounds.boxMin.Y;
+	const int endY = (int)visibleBounds.boxMax.Y;
+	if (firstX >= endX || firstY >= endY)
+		return;
+
+	// the finest level whose texels cover at least a pixel
+	const int worldLength = worldGen.GetWorldLength();
+	const int worldWidth = worldGen.GetWorldWidth();
+	int level = 0;
+	while ((GetMipSize(worldLength, level) > 1 || GetMipSize(worldWidth, level) > 1) && cellScale * (1 << level) < 1.0f)
+	{
+		++level;
+	}
+
+	// a window's vertices are addressed by 16 bit indices, so rectangles may have to be coarser still
+	auto visibleTexels = [=](int texelLevel)
+	{
+		const int texelSize = 1 << texelLevel;
+		return (((endX + texelSize - 1) >> texelLevel) - (firstX >> texelLevel)) * (((endY + texelSize - 1) >> texelLevel) - (firstY >> texelLevel));
+	};
+	const bool asTexture = DrawAsTexture && worldTexture;
+	while (!asTexture && (GetMipSize(worldLength, level) > 1 || GetMipSize(worldWidth, level) > 1) && visibleTexels(level) > MaxMipRects)
+	{
+		++level;
+	}
+
+	if (level > 0)
+		BuildWorldMips(worldGen);
+	drawnMipLevel = level;
+	drawnCellCount = asTexture ? 1 : visibleTexels(level);
+
+	const float texelSize = cellScale * (1 << level);
+	const int levelLength = GetMipSize(worldLength, level);
+	const int levelWidth = GetMipSize(worldWidth, level);
+	const int firstTexelX = firstX >> level;
+	const int endTexelX = (endX + (1 << level) - 1) >> level;
+	const int firstTexelY = firstY >> level;
+	const int endTexelY = (endY + (1 << level) - 1) >> level;
+	if (asTexture)
+	{
+		// the texture holds this level, a pixel per texel, of which only the visible part is drawn
+		drawList->AddImage(worldTexture,
+						   ImVec2(startPoint.x + (firstTexelX * texelSize), startPoint.y + (firstTexelY * texelSize)),
+						   ImVec2(startPoint.x + (endTexelX * texelSize), startPoint.y + (endTexelY * texelSize)),
+						   ImVec2((float)firstTexelX / levelLength, (float)firstTexelY / levelWidth),
+						   ImVec2((float)endTexelX / levelLength, (float)endTexelY / levelWidth));
+		return;
+	}
+
+	// texels are too small for borders
+	for (int x = firstTexelX; x < endTexelX; ++x)
+	{
+		for (int y = firstTexelY; y < endTexelY; ++y)
+		{
+			const ImU32 colour = (level == 0) ? worldGen.GetCellColour(x, y, showField) : mipLevels[level - 1][(y * levelLength) + x];
+			const ImVec2 texelStart(startPoint.x + (x * texelSize), startPoint.y + (y * texelSize));
+			drawList->AddRectFilled(texelStart, ImVec2(texelStart.x + texelSize, texelStart.y + texelSize), colour);
+		}
+	}
+}
+
+void WorldView::BuildWorldMips(TiledWorldGenerator& worldGen)
+{
+	PROFILE_SCOPE("BuildWorldMips");
+
+	const bool showField = worldGen.IsFieldShown();
+	worldGen.TrackPaletteColours();
+	if (mipsValid && mippedWorldGeneration == worldGen.GetWorldGeneration() && mippedFieldGeneration == worldGen.GetFieldGeneration() &&
+		mippedShowField == showField)
+		return;
+
+	// halve until a single texel covers the whole world
+	mippedLength = worldGen.GetWorldLength();
+	mippedWidth = worldGen.GetWorldWidth();
+	int levelCount = 0;
+	while (GetWorldMipLength(levelCount) > 1 || GetWorldMipWidth(levelCount) > 1)
+	{
+		++levelCount;
+	}
+	mipLevels.resize(levelCount);
+
+	// each level depends on the one below, but its rows can be built in any order
+	ThreadPool& pool = worldGen.GetThreadPool();
+	for (int level = 1; level <= levelCount; ++level)
+	{
+		const int levelLength = GetWorldMipLength(level);
+		mipLevels[level - 1].resize(levelLength * GetWorldMipWidth(level));
+
+		const int taskCount = (levelLength + MipRowsPerTask - 1) / MipRowsPerTask;
+		pool.ParallelFor(taskCount, [this, &worldGen, level, levelLength, showField](int taskIndex, unsigned)
+		{
+			const int firstRow = taskIndex * MipRowsPerTask;
+			BuildMipRows(worldGen, level, firstRow, std::min(firstRow + MipRowsPerTask, levelLength), showField);
+		});
+	}
+
+	mipsValid = true;
+	mippedWorldGeneration = worldGen.GetWorldGeneration();
+	mippedFieldGeneration = worldGen.GetFieldGeneration();
+	mippedShowField = showField;
+	++mipGeneration;
+}
+
+void WorldView::BuildMipRows(const TiledWorldGenerator& worldGen, int level, int firstRow, int endRow, bool showField)
+{
+	const int levelLength = GetWorldMipLength(level);
+	const int childLength = GetWorldMipLength(level - 1);
+	const int childWidth = GetWorldMipWidth(level - 1);
+	std::vector<ImU32>& texels = mipLevels[level - 1];
+
+	for (int x = firstRow; x < endRow; ++x)
+	{
+		for (int y = 0; y < GetWorldMipWidth(level); ++y)
+		{
+			// average each channel of the children that are inside the world, rounding to nearest
+			unsigned channelSums[4] = { 0, 0, 0, 0 };
+			unsigned childCount = 0;
+			for (int childX = x * 2; childX < std::min((x * 2) + 2, childLength); ++childX)
+			{
+				for (int childY = y * 2; childY < std::min((y * 2) + 2, childWidth); ++childY)
+				{
+					const ImU32 colour = (level == 1) ? worldGen.GetCellColour(childX, childY, showField) : mipLevels[level - 2][(childY * childLength) + childX];
+					for (int channel = 0; channel < 4; ++channel)
+					{
+						channelSums[channel] += (colour >> (channel * 8)) & 0xFF;
+					}
+					++childCount;
+				}
+			}
+
+			ImU32 average = 0;
+			for (int channel = 0; channel < 4; ++channel)
+			{
+				average |= ((channelSums[channel] + (childCount / 2)) / childCount) << (channel * 8);
+			}
+			texels[(y * levelLength) + x] = average;
+		}
+	}
+}
+
+void WorldView::DrawCells(const TiledWorldGenerator& worldGen, ImDrawList* drawList, const ImVec2& startPoint, int cellSize, const AABBf& visibleBounds,
+	bool showField) const
+{
+	const std::vector<Tile>& world = worldGen.GetWorld();
+	const int worldWidth = worldGen.GetWorldWidth();
+
+	// the grid is its own spatial index, so the visible cells are a range of rows and columns
+	for (int x = (int)visibleBounds.boxMin.X; x < (int)visibleBounds.boxMax.X; ++x)
+	{
+		for (int y = (int)visibleBounds.boxMin.Y; y < (int)visibleBounds.boxMax.Y; ++y)
+		{
+			// a compact world's colours come from the palette
+			const int cellIndex = (x * worldWidth) + y;
+			if (worldGen.IsWorldCompact())
+			{
+				DrawCell(worldGen, drawList, startPoint, cellSize, Vector2f((float)x, (float)y), worldGen.TilePalette[worldGen.GetCellPaletteIndex(x, y)]->Colour,
+						 worldGen.GetFieldAt(x, y), showField);
+			}
+			else
+			{
+				DrawCell(worldGen, drawList, startPoint, cellSize, world[cellIndex].Location, world[cellIndex].Colour, world[cellIndex].LocalFieldValue, showField);
+			}
+		}
+	}
+}
+
+void WorldView::AppendDrawCache(ImDrawList* drawList) const
+{
+	const int vertexCount = cellDrawList.VtxBuffer.Size;
+	const int indexCount = cellDrawList.IdxBuffer.Size;
+	if (indexCount == 0)
+		return;
+
+	// the vertices copy straight over, the indices need moving past the window's own vertices
+	drawList->PrimReserve(indexCount, vertexCount);
+	memcpy(drawList->_VtxWritePtr, cellDrawList.VtxBuffer.Data, vertexCount * sizeof(ImDrawVert));
+
+	const unsigned firstVertex = drawList->_VtxCurrentIdx;
+	for (int index = 0; index < indexCount; ++index)
+	{
+		drawList->_IdxWritePtr[index] = (ImDrawIdx)(firstVertex + cellDrawList.IdxBuffer.Data[index]);
+	}
+
+	drawList->_VtxWritePtr += vertexCount;
+	drawList->_IdxWritePtr += indexCount;
+	drawList->_VtxCurrentIdx += vertexCount;
+}
+
+void WorldView::ClampChunkView(const TiledWorldGenerator& worldGen, const ImVec2& viewSize, int& viewLength, int& viewWidth) const
+{
+	viewLength = std::max(worldGen.Length, 1);
+	viewWidth = std::max(worldGen.Width, 1);
+
+	// every cell is a rectangle, so there can be no more than fit the window's 16 bit indices, or than the window
+	// can show at MinCellPixels each
+	const float maxCells = std::min((float)MaxMipRects, std::max(viewSize.x, 0.0f) * std::max(viewSize.y, 0.0f) / (MinCellPixels * MinCellPixels));
+	if ((float)viewLength * viewWidth > maxCells)
+	{
+		const float shrink = std::sqrt(maxCells / ((float)viewLength * viewWidth));
+		viewLength = std::max((int)(viewLength * shrink), 1);
+		viewWidth = std::max((int)(viewWidth * shrink), 1);
+	}
+
+	// and every chunk the view touches has to stay cached, or each frame would generate them all again
+	const int chunkSize = TiledWorldGenerator::ChunkSize;
+	auto chunksAcross = [chunkSize](int cells) { return ((cells + chunkSize - 2) / chunkSize) + 1; };
+	while (chunksAcross(viewLength) * chunksAcross(viewWidth) > worldGen.GetChunkCapacity() && (viewLength > 1 || viewWidth > 1))
+	{
+		if (viewLength >= viewWidth)
+			viewLength = std::max(viewLength - chunkSize, 1);
+		else
+			viewWidth = std::max(viewWidth - chunkSize, 1);
+	}
+}
+
+void WorldView::DrawChunks(TiledWorldGenerator& worldGen, ImDrawList* drawList, const ImVec2& startPoint, int cellSize, int viewLength, int viewWidth) const
+{
+	// round down, the view can be anywhere in the world
+	const int chunkSize = TiledWorldGenerator::ChunkSize;
+	auto chunkOf = [chunkSize](int cell) { return (cell >= 0) ? (cell / chunkSize) : (((cell + 1) / chunkSize) - 1); };
+
+	// walk the view a chunk at a time, so each chunk is only looked up once
+	for (int chunkX = chunkOf(ChunkViewX); chunkX <= chunkOf(ChunkViewX + viewLength - 1); ++chunkX)
+	{
+		for (int chunkY = chunkOf(ChunkViewY); chunkY <= chunkOf(ChunkViewY + viewWidth - 1); ++chunkY)
+		{
+			const WorldChunk* chunkPtr = worldGen.GetChunk(chunkX, chunkY);
+			if (!chunkPtr)
+				return;
+
+			const WorldChunk& chunk = *chunkPtr;
+			const int firstX = std::max(ChunkViewX, chunkX * chunkSize);
+			const int endX = std::min(ChunkViewX + viewLength, (chunkX + 1) * chunkSize);
+			const int firstY = std::max(ChunkViewY, chunkY * chunkSize);
+			const int endY = std::min(ChunkViewY + viewWidth, (chunkY + 1) * chunkSize);
+
+			for (int x = firstX; x < endX; ++x)
+			{
+				for (int y = firstY; y < endY; ++y)
+				{
+					const int cellIndex = ((x - (chunkX * chunkSize)) * chunkSize) + (y - (chunkY * chunkSize));
+					const Vector2f location((float)(x - ChunkViewX), (float)(y - ChunkViewY));
+					DrawCell(worldGen, drawList, startPoint, cellSize, location, worldGen.TilePalette[chunk.Palette[cellIndex]]->Colour, chunk.Fields[cellIndex],
+							 worldGen.ShowField && chunk.LargestFieldStrength > 0);
+				}
+			}
+		}
+	}
+}
+
+void WorldView::DrawCell(const TiledWorldGenerator& worldGen, ImDrawList* drawList, const ImVec2& startPoint, int cellSize, const Vector2f& tileLocation,
+	ImColor colour, const Vector2f& field, bool showField) const
+{
+	// calculate the tile location
+	ImVec2 location = ImVec2((tileLocation.X * cellSize) + startPoint.x, (tileLocation.Y * cellSize) + startPoint.y);
+
+	// add the cell bounds
+	//drawList->AddRect(location, ImVec2(location.x + cellSize, location.y + cellSize), 0xFFFFFFFF);
+
+	// draw the cell
+	drawList->AddRectFilled(ImVec2(location.x + CellBorder, location.y + CellBorder),
+					        ImVec2(location.x + cellSize - CellBorder*2, location.y + cellSize - CellBorder*2),
+							worldGen.GetCellColour(colour, field, showField));
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <vector>
+#include "imgui.h"
+#include "AABB.h"
+#include "Vector.h"
+
+class TiledWorldGenerator;
+
+/**
+ * Draws a TiledWorldGenerator's world into an ImGui window, and keeps everything that only drawing needs: the camera,
+ * the rectangles retained between frames, the world's mip pyramid and the chunk view. The generator owns the world
+ * and its field, and a view only ever reads them, so several views could show the same world.
+ */
+class WorldView
+{
+public:
+	/**
+	 * Draws the world into the current window, either as a rectangle per cell or, if DrawAsTexture is set and
+	 * a texture is given, as a single textured quad. With CacheDraw set, the rectangles are only rebuilt when the
+	 * world, the field, the window's position or size, or the generator's ShowField changed since the last frame;
+	 * otherwise the last frame's vertices are copied.
+	 *
+	 * Only the cells the camera shows are drawn. Hovering over the window, the mouse wheel zooms about the
+	 * mouse and dragging with the left button pans. With ShowTreeNodes set, the tree's nodes in view are outlined.
+	 *
+	 * Cells smaller than MinCellPixels are drawn from the level of the world's mip pyramid whose texels are
+	 * closest to a pixel, so the cost depends on the window's size rather than the world's. Drawn as rectangles
+	 * the level is coarsened further to at most MaxMipRects texels, to fit the window's 16 bit indices.
+	 *
+	 * @param worldGen The generator whose world to draw.
+	 * @param worldTexture The texture holding the generator's world pixels, as kept up to date by WorldTexture.
+	 */
+	void DrawWorld(TiledWorldGenerator& worldGen, ImTextureID worldTexture = nullptr);
+
+	/** Moves the camera back to showing Length x Width cells from the world's origin. */
+	void ResetCamera();
+
+	/**
+	 * Rebuilds the world's mip pyramid if the world, its field or ShowField changed since it was last built. Each
+	 * level halves the one below it, down to a single texel, averaging the colours of (up to) four texels or, for
+	 * level 1, cells. The levels are built in parallel. DrawWorld calls this when it needs the pyramid.
+	 *
+	 * @param worldGen The generator whose world to build the pyramid of.
+	 */
+	void BuildWorldMips(TiledWorldGenerator& worldGen);
+
+	/** Gets the number of levels in the mip pyramid above the cells themselves. */
+	int GetWorldMipCount() const { return (int)mipLevels.size(); }
+
+	/**
+	 * Gets a level of the mip pyramid, laid out like the generator's world pixels.
+	 *
+	 * @param level The level, from 1 (half the cells along each side) to GetWorldMipCount.
+	 */
+	const std::vector<ImU32>& GetWorldMip(int level) const { return mipLevels[level - 1]; }
+	int GetWorldMipLength(int level) const { return GetMipSize(mippedLength, level); }
+	int GetWorldMipWidth(int level) const { return GetMipSize(mippedWidth, level); }
+
+	/** Counts the rebuilds of the mip pyramid. */
+	unsigned GetMipGeneration() const { return mipGeneration; }
+
+	/** Gets the mip level the last DrawWorld drew at, 0 if it drew the cells themselves. */
+	int GetDrawnMipLevel() const { return drawnMipLevel; }
+
+	/** Gets the number of cells (or mip texels, or textured quads) the last DrawWorld drew. */
+	int GetDrawnCellCount() const { return drawnCellCount; }
+
+	/** Gets the CPU time the last DrawWorld took, in microseconds. */
+	float GetDrawTime() const { return drawTime; }
+
+public:
+	/** Draw the world as one texture, a pixel per cell, rather than a rectangle per cell. Cells have no borders. */
+	bool DrawAsTexture = false;
+
+	/** Keep the rectangles drawn for the world between frames, rebuilding them only when something changed. */
+	bool CacheDraw = true;
+
+	/** The cell the window's top left corner shows, and the zoom relative to fitting Length x Width cells to the window. */
+	float CameraX = 0;
+	float CameraY = 0;
+	float CameraZoom = 1;
+
+	/** The zoom changes by this factor per step of the mouse wheel, between the two limits. */
+	static const float CameraZoomStep;
+	static const float MinCameraZoom;
+	static const float MaxCameraZoom;
+
+	/** Outline the tree's nodes that are in view. */
+	bool ShowTreeNodes = false;
+
+	/**
+	 * Draw a Length x Width window of the generator's chunked world, from ChunkViewX, ChunkViewY, instead of the
+	 * generated world. It is drawn a rectangle per cell with no camera, so a larger window is shrunk, keeping its shape,
+	 * to at most MaxMipRects cells of at least MinCellPixels each, over no more chunks than the cache holds.
+	 */
+	bool ShowChunks = false;
+	int ChunkViewX = 0;
+	int ChunkViewY = 0;
+
+	/** Cells drawn smaller than this many pixels a side are drawn from the mip pyramid instead. */
+	static const int MinCellPixels = 2;
+
+	/** The most texels of the mip pyramid drawn as rectangles, four vertices each. */
+	static const int MaxMipRects = 16000;
+
+	/** The mip pyramid is built in blocks of this many rows, which are shared out between the threads. */
+	static const int MipRowsPerTask = 16;
+
+protected:
+	static int GetMipSize(int cells, int level) { return (cells + (1 << level) - 1) >> level; }
+	float GetViewScale(float fitScale) const;
+	void UpdateCamera(const ImVec2& viewStart, float fitScale);
+	void DrawWorldMips(TiledWorldGenerator& worldGen, ImDrawList* drawList, const ImVec2& startPoint, float cellScale, const AABBf& visibleBounds,
+		ImTextureID worldTexture, bool showField);
+	void BuildMipRows(const TiledWorldGenerator& worldGen, int level, int firstRow, int endRow, bool showField);
+	void DrawCells(const TiledWorldGenerator& worldGen, ImDrawList* drawList, const ImVec2& startPoint, int cellSize, const AABBf& visibleBounds,
+		bool showField) const;
+	void AppendDrawCache(ImDrawList* drawList) const;
+	void ClampChunkView(const TiledWorldGenerator& worldGen, const ImVec2& viewSize, int& viewLength, int& viewWidth) const;
+	void DrawChunks(TiledWorldGenerator& worldGen, ImDrawList* drawList, const ImVec2& startPoint, int cellSize, int viewLength, int viewWidth) const;
+	void DrawCell(const TiledWorldGenerator& worldGen, ImDrawList* drawList, const ImVec2& startPoint, int cellSize, const Vector2f& tileLocation,
+		ImColor colour, const Vector2f& field, bool showField) const;
+
+protected:
+	ImDrawList cellDrawList;
+	bool drawCacheValid = false;
+	unsigned drawnWorldGeneration = 0;
+	unsigned drawnFieldGeneration = 0;
+	ImVec2 drawnStartPoint;
+	int drawnCellSize = 0;
+	bool drawnShowField = false;
+	AABBf drawnVisibleBounds;
+	int drawnCellCount = 0;
+	float drawTime = 0;
+	std::vector<std::vector<ImU32>> mipLevels;
+	bool mipsValid = false;
+	int mippedLength = 0;
+	int mippedWidth = 0;
+	unsigned mippedWorldGeneration = 0;
+	unsigned mippedFieldGeneration = 0;
+	bool mippedShowField = false;
+	unsigned mipGeneration = 0;
+	int drawnMipLevel = 0;
+};
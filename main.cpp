@@ -6,6 +6,9 @@
 #include <stdio.h>
 #include <GLFW/glfw3.h>
 #include "TiledWorldGenerator.h"
+#include "WorldTexture.h"
+#include "WorldView.h"
+#include "Profiler.h"
 #include <chrono>
 #include <string>
 #include <vector>
@@ -14,6 +17,7 @@ using namespace std;
 using namespace std::chrono;
 
 auto lastElapsedTime = 0LL;
+bool showProfiler = false;
 
 static void error_callback(int error, const char* description)
 {
@@ -23,6 +27,8 @@ static void error_callback(int error, const char* description)
 int main(int, char**)
 {
     TiledWorldGenerator worldGen;
+    WorldView worldView;
+    WorldTexture worldTexture;
 
 
     // Setup window
@@ -40,6 +46,8 @@ int main(int, char**)
     // Main loop
     while (!glfwWindowShouldClose(window))
     {
+        PROFILE_SCOPE("Frame");
+
         glfwPollEvents();
         ImGui_ImplGlfw_NewFrame();
 
@@ -53,34 +61,53 @@ int main(int, char**)
         if (ImGui::CollapsingHeader("World Configuration", ImGuiTreeNodeFlags_DefaultOpen))
         {
             // Draw the world configuration section
-            ImGui::SliderInt("Length", &worldGen.Length, 1, 60);
-            ImGui::SliderInt("Width", &worldGen.Width, 1, 60);
+            ImGui::DragInt("Length", &worldGen.Length, 1.0f, 1, 4096);
+            ImGui::DragInt("Width", &worldGen.Width, 1.0f, 1, 4096);
         }
 
         // tile configuration block
         if (ImGui::CollapsingHeader("Tile Configuration", ImGuiTreeNodeFlags_DefaultOpen))
         {
-            for(AvailableTile* tile : worldGen.TilePalette)
+            for (int paletteIndex = 0; paletteIndex < (int)worldGen.TilePalette.size(); ++paletteIndex)
             {
+                AvailableTile* tile = worldGen.TilePalette[paletteIndex];
                 if (ImGui::TreeNode(tile->Name.c_str()))
                 {
                     ImVec4 tileColour = tile->Colour;
                     ImGui::ColorEdit3("Colour", (float*)&tileColour);
                     tile->Colour = ImColor(tileColour);
-                    ImGui::SliderInt("Frequency", &(tile->Frequency), 1, 1000);
-                    ImGui::SliderFloat("Strength", &(tile->FieldStrength), 0, 50.0f);
-                    ImGui::SliderFloat("Range", &(tile->FieldRange), -1000.0f, 1000.0f);
+                    // the chunks were rolled from the old frequencies
+                    if (ImGui::SliderInt("Frequency", &(tile->Frequency), 1, 1000))
+                        worldGen.ResetChunks(worldGen.GetChunkCapacity());
+                    // changes are pushed to the existing tiles, and update the field straight away in layered mode
+                    float fieldStrength = tile->FieldStrength;
+                    if (ImGui::SliderFloat("Strength", &fieldStrength, 0, 50.0f))
+                        worldGen.SetFieldStrength(paletteIndex, fieldStrength);
+                    float fieldRange = tile->FieldRange;
+                    if (ImGui::SliderFloat("Range", &fieldRange, -1000.0f, 1000.0f))
+                        worldGen.SetFieldRange(paletteIndex, fieldRange);
                     ImGui::TreePop();
                 }
             }
         }
 
+        // the same seed always generates the same world
+        int seed = (int)worldGen.Seed;
+        if (ImGui::InputInt("Seed", &seed))
+            worldGen.Seed = (uint64_t)seed;
+
         // Check if we need to run the generation the world
         if (ImGui::Button("Generate"))
         {
             // generate the world
             worldGen.Generate();
         }
+        ImGui::SameLine();
+        if (ImGui::Button("Generate with next seed"))
+        {
+            ++worldGen.Seed;
+            worldGen.Generate();
+        }
 
         if (ImGui::Button("Rebuild Field"))
         {
@@ -97,20 +124,48 @@ int main(int, char**)
         }
 
         ImGui::Checkbox("Show field", &(worldGen.ShowField));
+        ImGui::Checkbox("Draw as texture", &(worldView.DrawAsTexture));
+        ImGui::Checkbox("Cache draw", &(worldView.CacheDraw));
+        ImGui::Checkbox("Show tree nodes", &(worldView.ShowTreeNodes));
+        if (ImGui::Button("Reset view"))
+            worldView.ResetCamera();
+#if PROFILER_ENABLED
+        ImGui::Checkbox("Show profiler", &showProfiler);
+#endif
+        ImGui::Checkbox("Bulk-load tree", &(worldGen.BulkLoadTree));
+        ImGui::Checkbox("Compact world", &(worldGen.CompactWorld));
+        ImGui::Checkbox("Show chunks", &(worldView.ShowChunks));
+        if (worldView.ShowChunks)
+        {
+            int chunkView[2] = { worldView.ChunkViewX, worldView.ChunkViewY };
+            if (ImGui::InputInt2("View from", chunkView))
+            {
+                worldView.ChunkViewX = chunkView[0];
+                worldView.ChunkViewY = chunkView[1];
+            }
+            ImGui::Text("Cached chunks: %d, drawn cells: %d", worldGen.GetCachedChunkCount(), worldView.GetDrawnCellCount());
+        }
+        ImGui::Combo("Field mode", (int*)&(worldGen.FieldCalculationMode), "Gather\0Scatter\0Convolution\0Layered\0Barnes-Hut\0\0");
+        ImGui::Combo("Gather kernel", (int*)&(worldGen.GatherKernel), "Scalar\0SSE\0AVX2\0\0");
+        ImGui::SliderInt("Threads (0 = all)", (int*)&(worldGen.ThreadCount), 0, 64);
+        ImGui::SliderFloat("Opening angle", &(worldGen.OpeningAngle), 0.0f, 2.0f);
+        ImGui::Checkbox("Measure approximation error", &(worldGen.MeasureApproximationError));
 
         ImGui::Text("Time: %lld microseconds", lastElapsedTime);
+        ImGui::Text("Draw: %.1f microseconds, %d cells", worldView.GetDrawTime(), worldView.GetDrawnCellCount());
+        if (worldGen.GetApproximationError() >= 0)
+            ImGui::Text("Max error: %g of the largest field", worldGen.GetApproximationError());
 
 		if (ImGui::Button("Search 10, 10 nodes"))
 		{
-			std::vector<Tile*> tempList = worldGen.ReturnSelectedNode(Vector2f(10, 10));
-
-			for (auto _tile : tempList)
+			int tileCount = 0;
+			worldGen.VisitSelectedNode(Vector2f(10, 10), [&tileCount](const Tile& _tile)
 			{
-				std::cout << _tile->Location.X << "," << _tile->Location.Y << " : ";
-			}
+				std::cout << _tile.Location.X << "," << _tile.Location.Y << " : ";
+				++tileCount;
+			});
 
-			std::cout << "CHeck tiles" << 
-			worldGen.ReturnSelectedNode(Vector2f(10, 10)).size();
+			std::cout << "CHeck tiles" << tileCount;
 		}
         
         ImGui::End();
@@ -120,21 +175,32 @@ int main(int, char**)
         ImGui::SetNextWindowPos(ImVec2(300, 0));
         ImGui::Begin("Level", nullptr, setupWindowFlags);
 
-        worldGen.DrawWorld();
+        worldView.DrawWorld(worldGen, worldTexture.GetTextureId());
+        if (worldView.DrawAsTexture)
+            worldTexture.Update(worldGen, worldView);
             
         ImGui::End();
 
+#if PROFILER_ENABLED
+        if (showProfiler)
+            Profiler::Instance().DrawPanel(&showProfiler);
+#endif
+
         // Rendering
         int display_w, display_h;
         glfwGetFramebufferSize(window, &display_w, &display_h);
         glViewport(0, 0, display_w, display_h);
         glClearColor(clear_color.x, clear_color.y, clear_color.z, clear_color.w);
         glClear(GL_COLOR_BUFFER_BIT);
-        ImGui::Render();
+        {
+            PROFILE_SCOPE("ImGui::Render");
+            ImGui::Render();
+        }
         glfwSwapBuffers(window);
     }
 
     // Cleanup
+    worldTexture.Release();
     ImGui_ImplGlfw_Shutdown();
     glfwTerminate();
 
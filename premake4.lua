@@ -6,10 +6,10 @@ project "AITestbed"
    kind "ConsoleApp"
    language "C++"
    includedirs { "./imgui/" }
-   files { "main.cpp", "TiledWorldGenerator.cpp",  "TiledWorldGenerator.h", "Tile.cpp", "TiledWorldGenerator.cpp", "imgui_impl_glfw.cpp", "./imgui/imgui.cpp", "./imgui/imgui_draw.cpp", "./imgui/imgui_demo.cpp" }
+   files { "main.cpp", "TiledWorldGenerator.cpp",  "TiledWorldGenerator.h", "Tile.cpp", "Node.cpp", "QuadTree.cpp", "LinearQuadTree.cpp", "FieldStencil.cpp", "FieldKernel.cpp", "ThreadPool.cpp", "FieldConvolution.cpp", "FieldAggregateTree.cpp", "ChunkCache.cpp", "Profiler.cpp", "WorldView.cpp", "WorldTexture.cpp", "imgui_impl_glfw.cpp", "./imgui/imgui.cpp", "./imgui/imgui_draw.cpp", "./imgui/imgui_demo.cpp" }
 
    configuration { "linux" }
-      links {"glfw3"}
+      links {"glfw3", "pthread"}
 
    configuration { "windows" }
       links {"glfw3", "gdi32", "opengl32", "imm32"}
@@ -28,4 +28,24 @@ project "AITestbed"
       flags { "Optimize", "ExtraWarnings"}
 
    configuration "gmake"
-      buildoptions { "-std=c++0x" }
\ No newline at end of file
+      buildoptions { "-std=c++0x" }
+
+project "Benchmark"
+   kind "ConsoleApp"
+   language "C++"
+   includedirs { "./imgui/" }
+   files { "Benchmark.cpp", "TiledWorldGenerator.cpp", "Tile.cpp", "Node.cpp", "QuadTree.cpp", "LinearQuadTree.cpp", "FieldStencil.cpp", "FieldKernel.cpp", "ThreadPool.cpp", "FieldConvolution.cpp", "FieldAggregateTree.cpp", "ChunkCache.cpp", "Profiler.cpp", "WorldView.cpp", "./imgui/imgui.cpp", "./imgui/imgui_draw.cpp" }
+
+   configuration { "linux" }
+      links {"pthread"}
+
+   configuration "Debug"
+      defines { "_DEBUG" }
+      flags { "Symbols", "ExtraWarnings"}
+
+   configuration "Release"
+      defines { "NDEBUG" }
+      flags { "Optimize", "ExtraWarnings"}
+
+   configuration "gmake"
+      buildoptions { "-std=c++0x" }